@@ -33,6 +33,11 @@ typedef struct {
   bool (*setctl_int)(TickitTermDriver *ttd, TickitTermCtl ctl, int value);
   bool (*setctl_str)(TickitTermDriver *ttd, TickitTermCtl ctl, const char *value);
   int  (*gotkey)(TickitTermDriver *ttd, TermKey *tk, const TermKeyKey *key); /* optional */
+  void (*begin_frame)(TickitTermDriver *ttd); /* optional */
+  void (*end_frame)(TickitTermDriver *ttd); /* optional */
+  bool (*printrep)(TickitTermDriver *ttd, const char *str, size_t len, int count); /* optional */
+  bool (*erase_below)(TickitTermDriver *ttd); /* optional */
+  bool (*print_acs)(TickitTermDriver *ttd, const char *acs, size_t len); /* optional */
 } TickitTermDriverVTable;
 
 struct TickitTermDriver {
@@ -43,7 +48,23 @@ struct TickitTermDriver {
 void *tickit_termdrv_get_tmpbuffer(TickitTermDriver *ttd, size_t len);
 void tickit_termdrv_write_str(TickitTermDriver *ttd, const char *str, size_t len);
 void tickit_termdrv_write_strf(TickitTermDriver *ttd, const char *fmt, ...);
+/* Returns space for up to len bytes of output to be written straight into,
+ * then sent by tickit_termdrv_commit() giving how many were used. Nothing
+ * else may be written to the terminal in between.
+ */
+char *tickit_termdrv_reserve(TickitTermDriver *ttd, size_t len);
+void tickit_termdrv_commit(TickitTermDriver *ttd, size_t len);
+/* cmd is an optional private-mode leader byte, any intermediate bytes, then
+ * the final byte. Negative parameters are written as empty.
+ */
+void tickit_termdrv_write_csi(TickitTermDriver *ttd, const char *cmd, int nparams, ...);
 TickitPen *tickit_termdrv_current_pen(TickitTermDriver *ttd);
+/* Returns false if the cursor position is not currently known */
+bool tickit_termdrv_get_cursor(TickitTermDriver *ttd, int *line, int *col);
+/* Raises TICKIT_EV_CAPS, for when a reply from the terminal changes what it
+ * is known to support
+ */
+void tickit_termdrv_caps_changed(TickitTermDriver *ttd);
 
 /*
  * Function to construct a new TickitTerm directly from a TickitTermDriver
@@ -11,6 +11,7 @@ extern "C" {
 #include <stdbool.h>
 
 #include <sys/time.h>
+#include <sys/uio.h>
 
 /* a tri-state yes/no/don't-know type */
 
@@ -30,6 +31,7 @@ typedef enum {
   TICKIT_EV_KEY    = 0x02, // Term = type(TickitKeyEventType), str
   TICKIT_EV_MOUSE  = 0x04, // Term = type(TickitMouseEventType), button, line, col
   TICKIT_EV_CHANGE = 0x08, // Pen = {none}
+  TICKIT_EV_CAPS   = 0x10, // Term = {none}
 
   TICKIT_EV_UNBIND = 0x80000000, // event handler is being unbound
 } TickitEventType;
@@ -184,6 +186,7 @@ bool tickit_rectset_contains(const TickitRectSet *trs, const TickitRect *rect);
 
 typedef struct TickitTerm TickitTerm;
 typedef void TickitTermOutputFunc(TickitTerm *tt, const char *bytes, size_t len, void *user);
+typedef void TickitTermOutputVFunc(TickitTerm *tt, const struct iovec *iov, int iovcnt, void *user);
 
 TickitTerm *tickit_term_new(void);
 TickitTerm *tickit_term_new_for_termtype(const char *termtype);
@@ -194,14 +197,49 @@ const char *tickit_term_get_termtype(TickitTerm *tt);
 void tickit_term_set_output_fd(TickitTerm *tt, int fd);
 int  tickit_term_get_output_fd(const TickitTerm *tt);
 void tickit_term_set_output_func(TickitTerm *tt, TickitTermOutputFunc *fn, void *user);
+void tickit_term_set_output_vfunc(TickitTerm *tt, TickitTermOutputVFunc *fn, void *user);
 void tickit_term_set_output_buffer(TickitTerm *tt, size_t len);
+void tickit_term_set_output_vectored(TickitTerm *tt, bool vectored);
+bool tickit_term_get_output_vectored(const TickitTerm *tt);
 
 // deprecate the unitless version
 #define tickit_term_await_started(tt, timeout) tickit_term_await_started_tv(tt, timeout)
 void tickit_term_await_started_msec(TickitTerm *tt, long msec);
 void tickit_term_await_started_tv(TickitTerm *tt, const struct timeval *timeout);
+bool tickit_term_is_started(TickitTerm *tt);
 void tickit_term_flush(TickitTerm *tt);
 
+size_t tickit_term_output_pending(const TickitTerm *tt);
+void tickit_term_output_writable(TickitTerm *tt);
+
+typedef enum {
+  TICKIT_TERM_WRITER_BLOCK, /* wait for the thread to make room */
+  TICKIT_TERM_WRITER_DROP,  /* discard output that does not fit */
+} TickitTermWriterPolicy;
+
+bool   tickit_term_set_output_thread(TickitTerm *tt, size_t bytes, TickitTermWriterPolicy policy);
+size_t tickit_term_output_dropped(TickitTerm *tt);
+
+typedef struct TickitIOUring TickitIOUring;
+
+TickitIOUring *tickit_iouring_new(unsigned int entries);
+void tickit_iouring_destroy(TickitIOUring *ring);
+int  tickit_iouring_get_fd(const TickitIOUring *ring);
+int  tickit_iouring_submit(TickitIOUring *ring);
+int  tickit_iouring_complete(TickitIOUring *ring, bool wait);
+
+bool tickit_term_set_iouring(TickitTerm *tt, TickitIOUring *ring);
+
+bool tickit_term_start_recording(TickitTerm *tt, int fd, size_t bytes);
+void tickit_term_stop_recording(TickitTerm *tt);
+
+void   tickit_term_set_output_limit(TickitTerm *tt, size_t bytes);
+size_t tickit_term_get_output_limit(const TickitTerm *tt);
+bool   tickit_term_is_congested(TickitTerm *tt);
+
+void tickit_term_begin_frame(TickitTerm *tt);
+void tickit_term_end_frame(TickitTerm *tt);
+
 /* fd is allowed to be unset (-1); works abstractly */
 void tickit_term_set_input_fd(TickitTerm *tt, int fd);
 int  tickit_term_get_input_fd(const TickitTerm *tt);
@@ -229,6 +267,9 @@ void tickit_term_unbind_event_id(TickitTerm *tt, int id);
 
 void tickit_term_print(TickitTerm *tt, const char *str);
 void tickit_term_printn(TickitTerm *tt, const char *str, size_t len);
+void tickit_term_printn_ref(TickitTerm *tt, const char *str, size_t len);
+void tickit_term_printrep(TickitTerm *tt, const char *str, size_t len, int count);
+bool tickit_term_print_acs(TickitTerm *tt, const char *acs, size_t len);
 void tickit_term_printf(TickitTerm *tt, const char *fmt, ...);
 void tickit_term_vprintf(TickitTerm *tt, const char *fmt, va_list args);
 bool tickit_term_goto(TickitTerm *tt, int line, int col);
@@ -240,6 +281,7 @@ void tickit_term_setpen(TickitTerm *tt, const TickitPen *pen);
 
 void tickit_term_clear(TickitTerm *tt);
 void tickit_term_erasech(TickitTerm *tt, int count, TickitMaybeBool moveend);
+bool tickit_term_erase_below(TickitTerm *tt);
 
 typedef enum {
   /* This is part of the API so additions must go at the end only */
@@ -253,6 +295,7 @@ typedef enum {
   TICKIT_TERMCTL_ICONTITLE_TEXT,
   TICKIT_TERMCTL_KEYPAD_APP,
   TICKIT_TERMCTL_COLORS, // read-only
+  TICKIT_TERMCTL_CAPS_CACHE,
 } TickitTermCtl;
 
 typedef enum {
@@ -372,6 +415,8 @@ void tickit_renderbuffer_eraserect(TickitRenderBuffer *rb, TickitRect *rect, Tic
 void tickit_renderbuffer_clear(TickitRenderBuffer *rb, TickitPen *pen);
 void tickit_renderbuffer_char_at(TickitRenderBuffer *rb, int line, int col, long codepoint, TickitPen *pen);
 void tickit_renderbuffer_char(TickitRenderBuffer *rb, long codepoint, TickitPen *pen);
+void tickit_renderbuffer_rgb_at(TickitRenderBuffer *rb, int line, int col, int width, int height,
+    const unsigned char *rgb, size_t stride, TickitPen *pen);
 
 typedef enum {
   TICKIT_LINE_SINGLE = 1,
@@ -390,8 +435,26 @@ void tickit_renderbuffer_hline_at(TickitRenderBuffer *rb, int line, int startcol
 void tickit_renderbuffer_vline_at(TickitRenderBuffer *rb, int startline, int endline, int col,
     TickitLineStyle style, TickitPen *pen, TickitLineCaps caps);
 
+void tickit_renderbuffer_braille_dot_at(TickitRenderBuffer *rb, int dotline, int dotcol, TickitPen *pen);
+void tickit_renderbuffer_braille_line_at(TickitRenderBuffer *rb, int startdotline, int startdotcol,
+    int enddotline, int enddotcol, TickitPen *pen);
+
+typedef enum {
+  TICKIT_RENDERBUFFER_FLUSH_GROUP_PENS      = 0x01,
+  TICKIT_RENDERBUFFER_FLUSH_MERGE_CONGESTED = 0x02,
+  TICKIT_RENDERBUFFER_FLUSH_REPEAT          = 0x04,
+  TICKIT_RENDERBUFFER_FLUSH_DIFF            = 0x08,
+  TICKIT_RENDERBUFFER_FLUSH_ACS             = 0x10,
+} TickitRenderBufferFlushFlags;
+
+void tickit_renderbuffer_set_flush_flags(TickitRenderBuffer *rb, TickitRenderBufferFlushFlags flags);
+TickitRenderBufferFlushFlags tickit_renderbuffer_get_flush_flags(const TickitRenderBuffer *rb);
+void tickit_renderbuffer_invalidate(TickitRenderBuffer *rb);
+
 void tickit_renderbuffer_flush_to_term(TickitRenderBuffer *rb, TickitTerm *tt);
 
+void tickit_renderbuffer_blit(TickitRenderBuffer *dst, TickitRenderBuffer *src);
+
 // This API is still somewhat experimental
 
 typedef struct {
@@ -419,6 +482,20 @@ struct TickitRenderBufferSpanInfo {
 // returns the text length or -1 on error
 size_t tickit_renderbuffer_get_span(TickitRenderBuffer *rb, int line, int startcol, struct TickitRenderBufferSpanInfo *info, char *buffer, size_t len);
 
+/*
+ * TickitBroadcast
+ */
+
+typedef struct TickitBroadcast TickitBroadcast;
+
+TickitBroadcast *tickit_broadcast_new(int lines, int cols);
+void tickit_broadcast_destroy(TickitBroadcast *bc);
+
+bool tickit_broadcast_add_term(TickitBroadcast *bc, TickitTerm *tt);
+void tickit_broadcast_remove_term(TickitBroadcast *bc, TickitTerm *tt);
+
+void tickit_broadcast_flush(TickitBroadcast *bc, TickitRenderBuffer *rb);
+
 #endif
 
 #ifdef __cplusplus
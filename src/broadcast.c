@@ -0,0 +1,286 @@
+/* We need strdup */
+#define _XOPEN_SOURCE 600
+
+#include "tickit.h"
+#include "tickit-termdrv.h"
+#include "term.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* How many frames are drawn over the retained frame before it is copied
+ * afresh, to free the text of cells that have since been overwritten
+ */
+#define RETAINED_COMPACT_FRAMES 64
+
+/* Viewers whose terminals would be sent identical bytes for a frame share a
+ * profile, whose master terminal encodes it once on all of their behalfs
+ */
+typedef struct {
+  char *termtype;
+  TickitMaybeBool utf8;
+
+  TickitTerm *master;
+  TickitRenderBuffer *rb; // kept per profile so FLUSH_DIFF has its own shadow
+
+  char *out;
+  size_t outlen;  // actually valid
+  size_t outsize; // allocated size
+
+  TickitTerm **viewers;
+  size_t n_viewers;    // number actually valid
+  size_t size_viewers; // size of allocated buffer
+} BCProfile;
+
+struct TickitBroadcast {
+  int lines, cols; // Size
+
+  BCProfile **profiles;
+  size_t n_profiles;    // number actually valid
+  size_t size_profiles; // size of allocated buffer
+
+  TickitRenderBuffer *retained; // everything drawn so far, for late joiners
+  TickitRenderBuffer *spare;
+  int retained_frames;
+};
+
+static void capture_output(TickitTerm *tt, const char *bytes, size_t len, void *user)
+{
+  BCProfile *p = user;
+
+  if(p->outsize < p->outlen + len) {
+    while(p->outsize < p->outlen + len)
+      p->outsize *= 2;
+    p->out = realloc(p->out, p->outsize);
+  }
+
+  memcpy(p->out + p->outlen, bytes, len);
+  p->outlen += len;
+}
+
+static BCProfile *new_profile(TickitBroadcast *bc, const char *termtype, TickitMaybeBool utf8)
+{
+  BCProfile *p = malloc(sizeof(BCProfile));
+  if(!p)
+    return NULL;
+
+  p->master = tickit_term_new_for_termtype(termtype);
+  if(!p->master) {
+    free(p);
+    return NULL;
+  }
+
+  p->termtype = strdup(termtype);
+  p->utf8     = utf8;
+
+  p->outsize = 1024;
+  p->out = malloc(p->outsize);
+  p->outlen = 0;
+
+  p->size_viewers = 4;
+  p->viewers = malloc(p->size_viewers * sizeof(TickitTerm *));
+  p->n_viewers = 0;
+
+  p->rb = tickit_renderbuffer_new(bc->lines, bc->cols);
+
+  if(utf8 != TICKIT_MAYBE)
+    tickit_term_set_utf8(p->master, utf8);
+  tickit_term_set_size(p->master, bc->lines, bc->cols);
+  tickit_term_set_output_buffer(p->master, 4096);
+  tickit_term_set_output_func(p->master, capture_output, p);
+
+  /* The viewers' own terminal instances have already started their
+   * terminals. The master's probes are discarded and never answered, so
+   * it only uses what every terminal of this type supports */
+  tickit_term_flush(p->master);
+  p->outlen = 0;
+
+  return p;
+}
+
+static void destroy_profile(BCProfile *p)
+{
+  tickit_term_destroy(p->master);
+  tickit_renderbuffer_destroy(p->rb);
+
+  free(p->termtype);
+  free(p->out);
+  free(p->viewers);
+  free(p);
+}
+
+TickitBroadcast *tickit_broadcast_new(int lines, int cols)
+{
+  TickitBroadcast *bc = malloc(sizeof(TickitBroadcast));
+  if(!bc)
+    return NULL;
+
+  bc->lines = lines;
+  bc->cols  = cols;
+
+  bc->size_profiles = 4;
+  bc->profiles = malloc(bc->size_profiles * sizeof(BCProfile *));
+  bc->n_profiles = 0;
+
+  bc->retained = tickit_renderbuffer_new(lines, cols);
+  bc->spare    = tickit_renderbuffer_new(lines, cols);
+  bc->retained_frames = 0;
+
+  return bc;
+}
+
+void tickit_broadcast_destroy(TickitBroadcast *bc)
+{
+  for(size_t i = 0; i < bc->n_profiles; i++) {
+    BCProfile *p = bc->profiles[i];
+    for(size_t v = 0; v < p->n_viewers; v++)
+      tickit_term_forget_state(p->viewers[v]);
+    destroy_profile(p);
+  }
+  free(bc->profiles);
+
+  tickit_renderbuffer_destroy(bc->retained);
+  tickit_renderbuffer_destroy(bc->spare);
+
+  free(bc);
+}
+
+static BCProfile *find_viewer(TickitBroadcast *bc, TickitTerm *tt, size_t *pidx, size_t *vidx)
+{
+  for(size_t i = 0; i < bc->n_profiles; i++) {
+    BCProfile *p = bc->profiles[i];
+    for(size_t v = 0; v < p->n_viewers; v++)
+      if(p->viewers[v] == tt) {
+        *pidx = i;
+        *vidx = v;
+        return p;
+      }
+  }
+
+  return NULL;
+}
+
+bool tickit_broadcast_add_term(TickitBroadcast *bc, TickitTerm *tt)
+{
+  size_t pidx, vidx;
+  if(find_viewer(bc, tt, &pidx, &vidx))
+    return false;
+
+  const char *termtype = tickit_term_get_termtype(tt);
+  if(!termtype)
+    return false;
+
+  TickitMaybeBool utf8 = tickit_term_get_utf8(tt);
+
+  BCProfile *p = NULL;
+  for(size_t i = 0; i < bc->n_profiles; i++)
+    if(strcmp(bc->profiles[i]->termtype, termtype) == 0 && bc->profiles[i]->utf8 == utf8) {
+      p = bc->profiles[i];
+      break;
+    }
+
+  if(!p) {
+    p = new_profile(bc, termtype, utf8);
+    if(!p)
+      return false;
+
+    if(bc->n_profiles == bc->size_profiles) {
+      bc->size_profiles *= 2;
+      bc->profiles = realloc(bc->profiles, bc->size_profiles * sizeof(BCProfile *));
+    }
+    bc->profiles[bc->n_profiles++] = p;
+  }
+
+  if(p->n_viewers == p->size_viewers) {
+    p->size_viewers *= 2;
+    p->viewers = realloc(p->viewers, p->size_viewers * sizeof(TickitTerm *));
+  }
+  p->viewers[p->n_viewers++] = tt;
+
+  /* Whatever the terminal showed before, repaint everything drawn so far */
+  tickit_term_forget_state(tt);
+
+  TickitPen *blank = tickit_pen_new();
+  tickit_term_setpen(tt, blank);
+  tickit_pen_destroy(blank);
+
+  tickit_term_clear(tt);
+
+  tickit_renderbuffer_blit(bc->spare, bc->retained);
+  tickit_renderbuffer_flush_to_term(bc->spare, tt);
+
+  /* Leave it in the state the master believes its viewers are in, so the
+   * next frame's bytes apply to it as to the others */
+  TickitTermDriver *ttd = tickit_term_get_driver(p->master);
+  tickit_term_setpen(tt, tickit_termdrv_current_pen(ttd));
+
+  int line, col;
+  if(tickit_termdrv_get_cursor(ttd, &line, &col))
+    tickit_term_goto(tt, line, col);
+
+  tickit_term_flush(tt);
+
+  return true;
+}
+
+void tickit_broadcast_remove_term(TickitBroadcast *bc, TickitTerm *tt)
+{
+  size_t pidx, vidx;
+  BCProfile *p = find_viewer(bc, tt, &pidx, &vidx);
+  if(!p)
+    return;
+
+  memmove(p->viewers + vidx, p->viewers + vidx + 1, (p->n_viewers - vidx - 1) * sizeof(TickitTerm *));
+  p->n_viewers--;
+
+  if(!p->n_viewers) {
+    destroy_profile(p);
+    memmove(bc->profiles + pidx, bc->profiles + pidx + 1, (bc->n_profiles - pidx - 1) * sizeof(BCProfile *));
+    bc->n_profiles--;
+  }
+}
+
+void tickit_broadcast_flush(TickitBroadcast *bc, TickitRenderBuffer *rb)
+{
+  TickitRenderBufferFlushFlags flags = tickit_renderbuffer_get_flush_flags(rb);
+
+  for(size_t i = 0; i < bc->n_profiles; i++) {
+    BCProfile *p = bc->profiles[i];
+
+    /* Setting the flags discards a FLUSH_DIFF shadow, so only if needed */
+    if(tickit_renderbuffer_get_flush_flags(p->rb) != flags)
+      tickit_renderbuffer_set_flush_flags(p->rb, flags);
+
+    tickit_renderbuffer_blit(p->rb, rb);
+    tickit_renderbuffer_flush_to_term(p->rb, p->master);
+    tickit_term_flush(p->master);
+
+    for(size_t v = 0; v < p->n_viewers; v++) {
+      TickitTerm *tt = p->viewers[v];
+
+      tickit_termdrv_write_str(tickit_term_get_driver(tt), p->out, p->outlen);
+      tickit_term_flush(tt);
+
+      /* It did not see what was written, so must not rely on what it
+       * believes about the terminal */
+      tickit_term_forget_state(tt);
+    }
+
+    p->outlen = 0;
+  }
+
+  tickit_renderbuffer_blit(bc->retained, rb);
+
+  if(++bc->retained_frames >= RETAINED_COMPACT_FRAMES) {
+    tickit_renderbuffer_blit(bc->spare, bc->retained);
+    tickit_renderbuffer_reset(bc->retained);
+
+    TickitRenderBuffer *tmp = bc->retained;
+    bc->retained = bc->spare;
+    bc->spare = tmp;
+
+    bc->retained_frames = 0;
+  }
+
+  tickit_renderbuffer_reset(rb);
+}
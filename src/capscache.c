@@ -0,0 +1,120 @@
+/* We need mkdir(), mkstemp() and fdopen() */
+#define _POSIX_C_SOURCE 200809L
+
+#include "capscache.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define CAPSCACHE_LINE 256
+
+/* Writes the path of the cache directory into buf, creating it first if
+ * asked to */
+static bool cache_dir(char *buf, size_t len, bool create)
+{
+  const char *xdg = getenv("XDG_CACHE_HOME");
+  int n;
+
+  /* The spec says relative paths are to be ignored */
+  if(xdg && xdg[0] == '/')
+    n = snprintf(buf, len, "%s/tickit", xdg);
+  else {
+    const char *home = getenv("HOME");
+    if(!home || !home[0])
+      return false;
+
+    n = snprintf(buf, len, "%s/.cache", home);
+    if(n < 0 || n >= len)
+      return false;
+    if(create)
+      mkdir(buf, 0700);
+
+    n = snprintf(buf, len, "%s/.cache/tickit", home);
+  }
+
+  if(n < 0 || n >= len)
+    return false;
+  if(create)
+    mkdir(buf, 0700);
+
+  return true;
+}
+
+static bool cache_path(char *buf, size_t len, const char *termtype, bool create)
+{
+  /* The termtype comes from the environment; don't let it name anything
+   * outside the cache directory */
+  if(!termtype[0] || termtype[0] == '.' || strchr(termtype, '/'))
+    return false;
+
+  if(!cache_dir(buf, len, create))
+    return false;
+
+  size_t dirlen = strlen(buf);
+  int n = snprintf(buf + dirlen, len - dirlen, "/%s", termtype);
+
+  return n >= 0 && n < len - dirlen;
+}
+
+bool tickit_capscache_load(const char *termtype, char *ident, size_t identlen, char *caps, size_t capslen)
+{
+  char path[1024];
+  if(!cache_path(path, sizeof path, termtype, false))
+    return false;
+
+  FILE *f = fopen(path, "r");
+  if(!f)
+    return false;
+
+  char line[CAPSCACHE_LINE];
+  bool ret = false;
+
+  if(fgets(line, sizeof line, f)) {
+    char *sp = strchr(line, ' ');
+    char *nl = strchr(line, '\n');
+
+    if(sp && nl && sp < nl &&
+       sp - line < identlen && nl - sp - 1 < capslen) {
+      memcpy(ident, line, sp - line);
+      ident[sp - line] = 0;
+      memcpy(caps, sp + 1, nl - sp - 1);
+      caps[nl - sp - 1] = 0;
+      ret = true;
+    }
+  }
+
+  fclose(f);
+  return ret;
+}
+
+void tickit_capscache_save(const char *termtype, const char *ident, const char *caps)
+{
+  char path[1024];
+  char tmppath[1024 + 8];
+
+  if(!cache_path(path, sizeof path, termtype, true))
+    return;
+
+  /* Write a new file and rename it over the old one, so that another process
+   * reading it concurrently never sees half of it */
+  snprintf(tmppath, sizeof tmppath, "%s.XXXXXX", path);
+
+  int fd = mkstemp(tmppath);
+  if(fd == -1)
+    return;
+
+  FILE *f = fdopen(fd, "w");
+  if(!f) {
+    close(fd);
+    unlink(tmppath);
+    return;
+  }
+
+  fprintf(f, "%s %s\n", ident, caps);
+
+  if(fclose(f) != 0 || rename(tmppath, path) != 0)
+    unlink(tmppath);
+}
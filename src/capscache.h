@@ -0,0 +1,17 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+/* An on-disk cache of what a terminal driver found out by probing, so the
+ * next program started on the same kind of terminal need not wait for the
+ * replies. There is one file per termtype under $XDG_CACHE_HOME/tickit,
+ * holding the identity of the terminal last seen using it and a string of
+ * capabilities in whatever form the driver likes. Neither may contain spaces
+ * or newlines.
+ */
+
+/* Fetches the last saved entry for termtype; false if there isn't one */
+bool tickit_capscache_load(const char *termtype, char *ident, size_t identlen, char *caps, size_t capslen);
+
+/* Replaces the entry for termtype. Failure is silently ignored; the cache is
+ * only ever an optimisation */
+void tickit_capscache_save(const char *termtype, const char *ident, const char *caps);
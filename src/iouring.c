@@ -0,0 +1,537 @@
+/* We need syscall() */
+#define _GNU_SOURCE
+
+#include "iouring.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+# if __has_include(<linux/io_uring.h>)
+#  define HAVE_IO_URING
+# endif
+#endif
+
+#ifdef HAVE_IO_URING
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#define INBUF_SIZE 4096
+
+/* Every terminal may have a read, a write and a cancel in flight at once, so
+ * leave the completion queue plenty of room beyond the submission queue. If
+ * it still overflows the kernel refuses submissions until completions are
+ * reaped, which prep() copes with */
+#define CQ_ENTRIES_PER_SQ 4
+
+/* user_data is the TickitIOUringTerm pointer with the operation in the low
+ * bits, which malloc() alignment leaves free */
+enum {
+  OP_READ,
+  OP_WRITE,
+  OP_CANCEL,
+
+  OP_MASK = 3,
+};
+
+struct TickitIOUringTerm {
+  struct TickitIOUringTerm *next;
+  TickitIOUring *ring;
+  TickitTerm *tt; /* NULL once detached */
+
+  int infd;  /* -1 once input has stopped */
+  int outfd;
+
+  bool reading; /* a read is in flight */
+  bool cancelling; /* a cancel of that read has been queued */
+  char inbuf[INBUF_SIZE];
+
+  bool writing; /* a write is in flight */
+  char  *outbuf;     /* being written */
+  size_t outbuf_len;
+  size_t outbuf_done;
+  size_t outbuf_size;
+
+  char  *queue;      /* to be written after outbuf */
+  size_t queue_len;
+  size_t queue_size;
+};
+
+struct TickitIOUring {
+  int fd;
+
+  /* Submission queue, shared with the kernel */
+  void *sq_ptr;
+  size_t sq_len;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned sq_entries;
+  struct io_uring_sqe *sqes;
+  size_t sqes_len;
+  unsigned to_submit; /* entries queued but not yet passed to the kernel */
+
+  /* Completion queue, shared with the kernel */
+  void *cq_ptr;
+  size_t cq_len;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  unsigned inflight; /* operations submitted but not yet completed */
+  bool stopping;
+
+  struct TickitIOUringTerm *terms;
+};
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/* READ and WRITE only arrived in 5.6, a release after io_uring_setup() and
+ * ASYNC_CANCEL; REGISTER_PROBE arrived with them, so a kernel that cannot
+ * answer it does not have them either */
+static bool probe_ops(int fd)
+{
+  size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+  struct io_uring_probe *probe = calloc(1, len);
+  if(!probe)
+    return false;
+
+  /* Ops beyond last_op are left zeroed, so unsupported */
+  bool ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+    (probe->ops[IORING_OP_READ].flags & IO_URING_OP_SUPPORTED) &&
+    (probe->ops[IORING_OP_WRITE].flags & IO_URING_OP_SUPPORTED);
+
+  free(probe);
+  return ok;
+}
+
+TickitIOUring *tickit_iouring_new(unsigned int entries)
+{
+  if(!entries)
+    entries = 64;
+
+  struct io_uring_params p;
+  memset(&p, 0, sizeof p);
+  p.flags      = IORING_SETUP_CQSIZE;
+  p.cq_entries = entries * CQ_ENTRIES_PER_SQ;
+
+  int fd = sys_io_uring_setup(entries, &p);
+  if(fd < 0 && errno == EINVAL) {
+    /* Kernels before 5.5 don't know CQSIZE; make do with the default */
+    memset(&p, 0, sizeof p);
+    fd = sys_io_uring_setup(entries, &p);
+  }
+  if(fd < 0)
+    return NULL;
+
+  if(!probe_ops(fd)) {
+    close(fd);
+    errno = ENOSYS;
+    return NULL;
+  }
+
+  TickitIOUring *ring = malloc(sizeof(TickitIOUring));
+  if(!ring) {
+    close(fd);
+    return NULL;
+  }
+
+  ring->fd = fd;
+
+  ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if(p.features & IORING_FEAT_SINGLE_MMAP) {
+    if(ring->cq_len > ring->sq_len)
+      ring->sq_len = ring->cq_len;
+    ring->cq_len = ring->sq_len;
+  }
+
+  ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if(ring->sq_ptr == MAP_FAILED)
+    goto fail_sq;
+
+  if(p.features & IORING_FEAT_SINGLE_MMAP)
+    ring->cq_ptr = ring->sq_ptr;
+  else {
+    ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if(ring->cq_ptr == MAP_FAILED)
+      goto fail_cq;
+  }
+
+  ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+  if(ring->sqes == MAP_FAILED)
+    goto fail_sqes;
+
+  char *sq = ring->sq_ptr, *cq = ring->cq_ptr;
+
+  ring->sq_head    = (unsigned *)(sq + p.sq_off.head);
+  ring->sq_tail    = (unsigned *)(sq + p.sq_off.tail);
+  ring->sq_mask    = (unsigned *)(sq + p.sq_off.ring_mask);
+  ring->sq_array   = (unsigned *)(sq + p.sq_off.array);
+  ring->sq_entries = p.sq_entries;
+  ring->to_submit  = 0;
+
+  ring->cq_head = (unsigned *)(cq + p.cq_off.head);
+  ring->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  ring->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  ring->cqes    = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+  ring->inflight = 0;
+  ring->stopping = false;
+  ring->terms = NULL;
+
+  return ring;
+
+fail_sqes:
+  if(ring->cq_ptr != ring->sq_ptr)
+    munmap(ring->cq_ptr, ring->cq_len);
+fail_cq:
+  munmap(ring->sq_ptr, ring->sq_len);
+fail_sq:
+  close(fd);
+  free(ring);
+  return NULL;
+}
+
+int tickit_iouring_get_fd(const TickitIOUring *ring)
+{
+  return ring->fd;
+}
+
+/* Passes queued entries to the kernel, optionally waiting for at least
+ * min_complete completions */
+static void enter(TickitIOUring *ring, unsigned min_complete)
+{
+  while(ring->to_submit || min_complete) {
+    int ret = sys_io_uring_enter(ring->fd, ring->to_submit, min_complete,
+        min_complete ? IORING_ENTER_GETEVENTS : 0);
+    if(ret < 0) {
+      if(errno == EINTR)
+        continue;
+      /* Most likely EAGAIN or EBUSY because completions must be reaped
+       * first; the caller will do that and try again */
+      return;
+    }
+
+    ring->to_submit -= ret;
+    ring->inflight  += ret;
+    return;
+  }
+}
+
+/* Queues an operation, returning false if there is no room for it yet. The
+ * caller must then leave it for a later round, after completions have been
+ * reaped */
+static bool prep(TickitIOUring *ring, int opcode, int fd, void *addr, unsigned len, struct TickitIOUringTerm *ut, int op)
+{
+  if(ring->to_submit == ring->sq_entries) {
+    enter(ring, 0);
+    /* enter() failed, so the oldest unsubmitted entry is still in the slot
+     * we would otherwise use */
+    if(ring->to_submit == ring->sq_entries)
+      return false;
+  }
+
+  /* Only we store the tail, so there's no need to load it atomically */
+  unsigned tail = *ring->sq_tail;
+  unsigned idx = tail & *ring->sq_mask;
+
+  struct io_uring_sqe *sqe = &ring->sqes[idx];
+  memset(sqe, 0, sizeof *sqe);
+  sqe->opcode    = opcode;
+  sqe->fd        = fd;
+  sqe->addr      = (uintptr_t)addr;
+  sqe->len       = len;
+  sqe->off       = (uint64_t)-1; /* current position; ttys and pipes have none */
+  sqe->user_data = (uintptr_t)ut | op;
+
+  ring->sq_array[idx] = idx;
+  __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  ring->to_submit++;
+  return true;
+}
+
+static bool cancel(TickitIOUring *ring, struct TickitIOUringTerm *ut, int op)
+{
+  if(!prep(ring, IORING_OP_ASYNC_CANCEL, -1, NULL, 0, ut, OP_CANCEL))
+    return false;
+
+  /* The target is identified by its user_data, given in addr; off must be
+   * zero or the kernel rejects it */
+  unsigned idx = (*ring->sq_tail - 1) & *ring->sq_mask;
+  ring->sqes[idx].addr = (uintptr_t)ut | op;
+  ring->sqes[idx].off  = 0;
+
+  return true;
+}
+
+static void free_term(struct TickitIOUringTerm *ut)
+{
+  free(ut->outbuf);
+  free(ut->queue);
+  free(ut);
+}
+
+/* Queues a read for every terminal not already reading and a write for
+ * every terminal with output waiting, and frees detached terminals that
+ * have finished */
+static void prep_all(TickitIOUring *ring)
+{
+  for(struct TickitIOUringTerm **utp = &ring->terms; *utp; /**/) {
+    struct TickitIOUringTerm *ut = *utp;
+
+    if(!ut->writing && !ring->stopping) {
+      if(ut->outbuf_done == ut->outbuf_len && ut->queue_len) {
+        /* Swap the buffers over, so neither need be reallocated */
+        char *buf = ut->outbuf;
+        size_t size = ut->outbuf_size;
+
+        ut->outbuf      = ut->queue;
+        ut->outbuf_size = ut->queue_size;
+        ut->outbuf_len  = ut->queue_len;
+        ut->outbuf_done = 0;
+
+        ut->queue      = buf;
+        ut->queue_size = size;
+        ut->queue_len  = 0;
+      }
+
+      if(ut->outbuf_done < ut->outbuf_len &&
+          prep(ring, IORING_OP_WRITE, ut->outfd, ut->outbuf + ut->outbuf_done,
+            ut->outbuf_len - ut->outbuf_done, ut, OP_WRITE))
+        ut->writing = true;
+    }
+
+    if(!ut->reading && ut->infd != -1 && !ring->stopping &&
+        prep(ring, IORING_OP_READ, ut->infd, ut->inbuf, INBUF_SIZE, ut, OP_READ))
+      ut->reading = true;
+
+    /* Input has stopped while a read was still waiting */
+    if(ut->reading && ut->infd == -1 && !ut->cancelling &&
+        cancel(ring, ut, OP_READ))
+      ut->cancelling = true;
+
+    bool done = !ut->reading && !ut->writing &&
+      (ring->stopping || (ut->outbuf_done == ut->outbuf_len && !ut->queue_len));
+    if(!ut->tt && done) {
+      *utp = ut->next;
+      free_term(ut);
+      continue;
+    }
+
+    utp = &ut->next;
+  }
+}
+
+static void complete_op(TickitIOUring *ring, uint64_t user_data, int res)
+{
+  struct TickitIOUringTerm *ut = (struct TickitIOUringTerm *)(uintptr_t)(user_data & ~(uint64_t)OP_MASK);
+
+  switch(user_data & OP_MASK) {
+    case OP_READ:
+      ut->reading = false;
+      ut->cancelling = false;
+      if(res > 0) {
+        if(ut->tt)
+          tickit_term_input_push_bytes(ut->tt, ut->inbuf, res);
+      }
+      else if(res != -EAGAIN && res != -EINTR)
+        /* End of file, cancelled, or failed; either way, stop reading */
+        ut->infd = -1;
+      break;
+
+    case OP_WRITE:
+      ut->writing = false;
+      if(res > 0)
+        ut->outbuf_done += res;
+      else if(res != -EAGAIN && res != -EINTR)
+        /* Any other error; the output is lost */
+        ut->outbuf_done = ut->outbuf_len;
+      break;
+
+    case OP_CANCEL:
+      break;
+  }
+}
+
+/* Handles every completion that is ready, returning how many there were */
+static int reap(TickitIOUring *ring)
+{
+  int count = 0;
+  unsigned head = *ring->cq_head;
+
+  while(head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+    struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+    uint64_t user_data = cqe->user_data;
+    int res = cqe->res;
+
+    /* Release the slot before running anything that might submit more */
+    head++;
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+    ring->inflight--;
+    complete_op(ring, user_data, res);
+    count++;
+  }
+
+  return count;
+}
+
+int tickit_iouring_submit(TickitIOUring *ring)
+{
+  prep_all(ring);
+  enter(ring, 0);
+
+  return ring->inflight;
+}
+
+int tickit_iouring_complete(TickitIOUring *ring, bool wait)
+{
+  prep_all(ring);
+
+  bool ready = *ring->cq_head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+  enter(ring, wait && !ready && (ring->inflight || ring->to_submit) ? 1 : 0);
+
+  int count = reap(ring);
+
+  /* Reading again, and any output written by input handlers */
+  prep_all(ring);
+  enter(ring, 0);
+
+  return count;
+}
+
+struct TickitIOUringTerm *tickit_iouring_attach(TickitIOUring *ring, TickitTerm *tt, int infd, int outfd)
+{
+  struct TickitIOUringTerm *ut = malloc(sizeof(struct TickitIOUringTerm));
+  if(!ut)
+    return NULL;
+
+  ut->ring  = ring;
+  ut->tt    = tt;
+  ut->infd  = infd;
+  ut->outfd = outfd;
+
+  ut->reading = ut->writing = false;
+  ut->cancelling = false;
+
+  ut->outbuf = NULL;
+  ut->outbuf_len = ut->outbuf_done = ut->outbuf_size = 0;
+  ut->queue = NULL;
+  ut->queue_len = ut->queue_size = 0;
+
+  ut->next = ring->terms;
+  ring->terms = ut;
+
+  return ut;
+}
+
+void tickit_iouring_detach(struct TickitIOUringTerm *ut)
+{
+  TickitIOUring *ring = ut->ring;
+
+  ut->tt = NULL;
+  ut->infd = -1;
+
+  /* Cancels any read, and sends whatever output remains; the terminal is
+   * freed once done */
+  prep_all(ring);
+  enter(ring, 0);
+}
+
+void tickit_iouring_write(struct TickitIOUringTerm *ut, const char *bytes, size_t len)
+{
+  if(ut->queue_size < ut->queue_len + len) {
+    size_t newsize = ut->queue_size ? ut->queue_size : 1024;
+    while(newsize < ut->queue_len + len)
+      newsize *= 2;
+
+    ut->queue = realloc(ut->queue, newsize);
+    ut->queue_size = newsize;
+  }
+
+  memcpy(ut->queue + ut->queue_len, bytes, len);
+  ut->queue_len += len;
+}
+
+size_t tickit_iouring_pending(const struct TickitIOUringTerm *ut)
+{
+  return ut->queue_len + (ut->outbuf_len - ut->outbuf_done);
+}
+
+void tickit_iouring_destroy(TickitIOUring *ring)
+{
+  /* Detaching may free other terminals from the list, so start again from
+   * the top each time */
+  while(1) {
+    struct TickitIOUringTerm *ut = ring->terms;
+    while(ut && !ut->tt)
+      ut = ut->next;
+    if(!ut)
+      break;
+
+    tickit_term_set_iouring(ut->tt, NULL);
+  }
+
+  /* Abandon anything still in flight; the kernel must be done with the
+   * buffers before they can be freed */
+  ring->stopping = true;
+  for(struct TickitIOUringTerm *ut = ring->terms; ut; ut = ut->next) {
+    /* Make room by reaping whenever the ring is full */
+    while(ut->reading && !cancel(ring, ut, OP_READ)) {
+      enter(ring, ring->inflight ? 1 : 0);
+      reap(ring);
+    }
+    while(ut->writing && !cancel(ring, ut, OP_WRITE)) {
+      enter(ring, ring->inflight ? 1 : 0);
+      reap(ring);
+    }
+  }
+
+  while(ring->inflight || ring->to_submit) {
+    enter(ring, ring->inflight ? 1 : 0);
+    reap(ring);
+  }
+
+  prep_all(ring);
+
+  munmap(ring->sqes, ring->sqes_len);
+  if(ring->cq_ptr != ring->sq_ptr)
+    munmap(ring->cq_ptr, ring->cq_len);
+  munmap(ring->sq_ptr, ring->sq_len);
+  close(ring->fd);
+  free(ring);
+}
+
+#else /* !HAVE_IO_URING */
+
+TickitIOUring *tickit_iouring_new(unsigned int entries)
+{
+  errno = ENOSYS;
+  return NULL;
+}
+
+/* No ring can exist to call any of these with */
+void tickit_iouring_destroy(TickitIOUring *ring) {}
+int  tickit_iouring_get_fd(const TickitIOUring *ring) { return -1; }
+int  tickit_iouring_submit(TickitIOUring *ring) { return 0; }
+int  tickit_iouring_complete(TickitIOUring *ring, bool wait) { return 0; }
+
+struct TickitIOUringTerm *tickit_iouring_attach(TickitIOUring *ring, TickitTerm *tt, int infd, int outfd) { return NULL; }
+void tickit_iouring_detach(struct TickitIOUringTerm *ut) {}
+void tickit_iouring_write(struct TickitIOUringTerm *ut, const char *bytes, size_t len) {}
+size_t tickit_iouring_pending(const struct TickitIOUringTerm *ut) { return 0; }
+
+#endif
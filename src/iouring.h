@@ -0,0 +1,13 @@
+#include "tickit.h"
+
+/* A terminal's share of a TickitIOUring; output is queued here until the
+ * ring is next submitted, and input is read into here.
+ */
+struct TickitIOUringTerm;
+
+struct TickitIOUringTerm *tickit_iouring_attach(TickitIOUring *ring, TickitTerm *tt, int infd, int outfd);
+/* The terminal is going away; any output already queued is still written */
+void tickit_iouring_detach(struct TickitIOUringTerm *ut);
+
+void tickit_iouring_write(struct TickitIOUringTerm *ut, const char *bytes, size_t len);
+size_t tickit_iouring_pending(const struct TickitIOUringTerm *ut);
@@ -1,5 +1,6 @@
 #include "tickit.h"
 #include "hooklists.h"
+#include "pen.h"
 
 #include <stdarg.h>
 #include <stdio.h>   /* sscanf */
@@ -8,34 +9,6 @@
 
 #define streq(a,b) (!strcmp(a,b))
 
-struct TickitPen {
-  signed   int fg      : 9, /* 0 - 255 or -1 */
-               bg      : 9; /* 0 - 255 or -1 */
-
-  unsigned int bold    : 1,
-               under   : 1,
-               italic  : 1,
-               reverse : 1,
-               strike  : 1,
-               blink   : 1;
-
-  signed   int altfont : 5; /* 1 - 10 or -1 */
-
-  struct {
-    unsigned int fg      : 1,
-                 bg      : 1,
-                 bold    : 1,
-                 under   : 1,
-                 italic  : 1,
-                 reverse : 1,
-                 strike  : 1,
-                 altfont : 1,
-                 blink   : 1;
-  } valid;
-
-  struct TickitEventHook *hooks;
-};
-
 DEFINE_HOOKLIST_FUNCS(pen,TickitPen,TickitPenEventFn)
 
 TickitPen *tickit_pen_new(void)
@@ -44,9 +17,7 @@ TickitPen *tickit_pen_new(void)
   if(!pen)
     return NULL;
 
-  pen->hooks = NULL;
-
-  tickit_pen_clear(pen);
+  pen_init_empty(pen);
 
   return pen;
 }
@@ -105,22 +76,10 @@ void tickit_pen_destroy(TickitPen *pen)
 
 bool tickit_pen_has_attr(const TickitPen *pen, TickitPenAttr attr)
 {
-  switch(attr) {
-    case TICKIT_PEN_FG:      return pen->valid.fg;
-    case TICKIT_PEN_BG:      return pen->valid.bg;
-    case TICKIT_PEN_BOLD:    return pen->valid.bold;
-    case TICKIT_PEN_UNDER:   return pen->valid.under;
-    case TICKIT_PEN_ITALIC:  return pen->valid.italic;
-    case TICKIT_PEN_REVERSE: return pen->valid.reverse;
-    case TICKIT_PEN_STRIKE:  return pen->valid.strike;
-    case TICKIT_PEN_ALTFONT: return pen->valid.altfont;
-    case TICKIT_PEN_BLINK:   return pen->valid.blink;
-
-    case TICKIT_N_PEN_ATTRS:
-      return false;
-  }
+  if(attr < 0 || attr >= TICKIT_N_PEN_ATTRS)
+    return false;
 
-  return false;
+  return pen->valid & PEN_ATTR_BIT(attr);
 }
 
 bool tickit_pen_nondefault_attr(const TickitPen *pen, TickitPenAttr attr)
@@ -148,11 +107,7 @@ bool tickit_pen_nondefault_attr(const TickitPen *pen, TickitPenAttr attr)
 
 bool tickit_pen_is_nonempty(const TickitPen *pen)
 {
-  for(TickitPenAttr attr = 0; attr < TICKIT_N_PEN_ATTRS; attr++) {
-    if(tickit_pen_has_attr(pen, attr))
-      return true;
-  }
-  return false;
+  return pen->valid != 0;
 }
 
 bool tickit_pen_is_nondefault(const TickitPen *pen)
@@ -184,12 +139,12 @@ bool tickit_pen_get_bool_attr(const TickitPen *pen, TickitPenAttr attr)
 void tickit_pen_set_bool_attr(TickitPen *pen, TickitPenAttr attr, bool val)
 {
   switch(attr) {
-    case TICKIT_PEN_BOLD:    pen->bold    = !!val; pen->valid.bold    = 1; break;
-    case TICKIT_PEN_UNDER:   pen->under   = !!val; pen->valid.under   = 1; break;
-    case TICKIT_PEN_ITALIC:  pen->italic  = !!val; pen->valid.italic  = 1; break;
-    case TICKIT_PEN_REVERSE: pen->reverse = !!val; pen->valid.reverse = 1; break;
-    case TICKIT_PEN_STRIKE:  pen->strike  = !!val; pen->valid.strike  = 1; break;
-    case TICKIT_PEN_BLINK:   pen->blink   = !!val; pen->valid.blink   = 1; break;
+    case TICKIT_PEN_BOLD:    pen->bold    = !!val; pen->valid |= PEN_ATTR_BIT(TICKIT_PEN_BOLD); break;
+    case TICKIT_PEN_UNDER:   pen->under   = !!val; pen->valid |= PEN_ATTR_BIT(TICKIT_PEN_UNDER); break;
+    case TICKIT_PEN_ITALIC:  pen->italic  = !!val; pen->valid |= PEN_ATTR_BIT(TICKIT_PEN_ITALIC); break;
+    case TICKIT_PEN_REVERSE: pen->reverse = !!val; pen->valid |= PEN_ATTR_BIT(TICKIT_PEN_REVERSE); break;
+    case TICKIT_PEN_STRIKE:  pen->strike  = !!val; pen->valid |= PEN_ATTR_BIT(TICKIT_PEN_STRIKE); break;
+    case TICKIT_PEN_BLINK:   pen->blink   = !!val; pen->valid |= PEN_ATTR_BIT(TICKIT_PEN_BLINK); break;
     default:
       return;
   }
@@ -211,7 +166,7 @@ int tickit_pen_get_int_attr(const TickitPen *pen, TickitPenAttr attr)
 void tickit_pen_set_int_attr(TickitPen *pen, TickitPenAttr attr, int val)
 {
   switch(attr) {
-    case TICKIT_PEN_ALTFONT: pen->altfont = val; pen->valid.altfont = 1; break;
+    case TICKIT_PEN_ALTFONT: pen->altfont = val; pen->valid |= PEN_ATTR_BIT(TICKIT_PEN_ALTFONT); break;
     default:
       return;
   }
@@ -235,8 +190,8 @@ int tickit_pen_get_colour_attr(const TickitPen *pen, TickitPenAttr attr)
 void tickit_pen_set_colour_attr(TickitPen *pen, TickitPenAttr attr, int val)
 {
   switch(attr) {
-    case TICKIT_PEN_FG: pen->fg = val; pen->valid.fg = 1; break;
-    case TICKIT_PEN_BG: pen->bg = val; pen->valid.bg = 1; break;
+    case TICKIT_PEN_FG: pen->fg = val; pen->valid |= PEN_ATTR_BIT(TICKIT_PEN_FG); break;
+    case TICKIT_PEN_BG: pen->bg = val; pen->valid |= PEN_ATTR_BIT(TICKIT_PEN_BG); break;
     default:
       return;
   }
@@ -295,15 +250,15 @@ bool tickit_pen_set_colour_attr_desc(TickitPen *pen, TickitPenAttr attr, const c
 void tickit_pen_clear_attr(TickitPen *pen, TickitPenAttr attr)
 {
   switch(attr) {
-    case TICKIT_PEN_FG:      pen->valid.fg      = 0; break;
-    case TICKIT_PEN_BG:      pen->valid.bg      = 0; break;
-    case TICKIT_PEN_BOLD:    pen->valid.bold    = 0; break;
-    case TICKIT_PEN_UNDER:   pen->valid.under   = 0; break;
-    case TICKIT_PEN_ITALIC:  pen->valid.italic  = 0; break;
-    case TICKIT_PEN_REVERSE: pen->valid.reverse = 0; break;
-    case TICKIT_PEN_STRIKE:  pen->valid.strike  = 0; break;
-    case TICKIT_PEN_ALTFONT: pen->valid.altfont = 0; break;
-    case TICKIT_PEN_BLINK:   pen->valid.blink   = 0; break;
+    case TICKIT_PEN_FG:      pen->valid &= ~PEN_ATTR_BIT(TICKIT_PEN_FG); break;
+    case TICKIT_PEN_BG:      pen->valid &= ~PEN_ATTR_BIT(TICKIT_PEN_BG); break;
+    case TICKIT_PEN_BOLD:    pen->valid &= ~PEN_ATTR_BIT(TICKIT_PEN_BOLD); break;
+    case TICKIT_PEN_UNDER:   pen->valid &= ~PEN_ATTR_BIT(TICKIT_PEN_UNDER); break;
+    case TICKIT_PEN_ITALIC:  pen->valid &= ~PEN_ATTR_BIT(TICKIT_PEN_ITALIC); break;
+    case TICKIT_PEN_REVERSE: pen->valid &= ~PEN_ATTR_BIT(TICKIT_PEN_REVERSE); break;
+    case TICKIT_PEN_STRIKE:  pen->valid &= ~PEN_ATTR_BIT(TICKIT_PEN_STRIKE); break;
+    case TICKIT_PEN_ALTFONT: pen->valid &= ~PEN_ATTR_BIT(TICKIT_PEN_ALTFONT); break;
+    case TICKIT_PEN_BLINK:   pen->valid &= ~PEN_ATTR_BIT(TICKIT_PEN_BLINK); break;
 
     case TICKIT_N_PEN_ATTRS:
       return;
@@ -374,39 +329,39 @@ void tickit_pen_copy(TickitPen *dst, const TickitPen *src, bool overwrite)
     switch(attr) {
     case TICKIT_PEN_FG:
       dst->fg = src->fg;
-      dst->valid.fg = 1;
+      dst->valid |= PEN_ATTR_BIT(TICKIT_PEN_FG);
       break;
     case TICKIT_PEN_BG:
       dst->bg = src->bg;
-      dst->valid.bg = 1;
+      dst->valid |= PEN_ATTR_BIT(TICKIT_PEN_BG);
       break;
     case TICKIT_PEN_BOLD:
       dst->bold = src->bold;
-      dst->valid.bold = 1;
+      dst->valid |= PEN_ATTR_BIT(TICKIT_PEN_BOLD);
       break;
     case TICKIT_PEN_ITALIC:
       dst->italic = src->italic;
-      dst->valid.italic = 1;
+      dst->valid |= PEN_ATTR_BIT(TICKIT_PEN_ITALIC);
       break;
     case TICKIT_PEN_UNDER:
       dst->under = src->under;
-      dst->valid.under = 1;
+      dst->valid |= PEN_ATTR_BIT(TICKIT_PEN_UNDER);
       break;
     case TICKIT_PEN_REVERSE:
       dst->reverse = src->reverse;
-      dst->valid.reverse = 1;
+      dst->valid |= PEN_ATTR_BIT(TICKIT_PEN_REVERSE);
       break;
     case TICKIT_PEN_STRIKE:
       dst->strike = src->strike;
-      dst->valid.strike = 1;
+      dst->valid |= PEN_ATTR_BIT(TICKIT_PEN_STRIKE);
       break;
     case TICKIT_PEN_ALTFONT:
       dst->altfont = src->altfont;
-      dst->valid.altfont = 1;
+      dst->valid |= PEN_ATTR_BIT(TICKIT_PEN_ALTFONT);
       break;
     case TICKIT_PEN_BLINK:
       dst->blink = src->blink;
-      dst->valid.blink = 1;
+      dst->valid |= PEN_ATTR_BIT(TICKIT_PEN_BLINK);
       break;
     case TICKIT_N_PEN_ATTRS:
       continue;
@@ -0,0 +1,114 @@
+#include "tickit.h"
+
+/* Private view of TickitPen, so hot paths such as TickitTerm's pen changes
+ * can work on whole pens at once without going through the per-attribute
+ * accessors
+ */
+
+struct TickitPen {
+  signed   int fg      : 9, /* 0 - 255 or -1 */
+               bg      : 9; /* 0 - 255 or -1 */
+
+  unsigned int bold    : 1,
+               under   : 1,
+               italic  : 1,
+               reverse : 1,
+               strike  : 1,
+               blink   : 1;
+
+  signed   int altfont : 5; /* 1 - 10 or -1 */
+
+  unsigned int valid; /* bitmask of PEN_ATTR_BIT() */
+
+  struct TickitEventHook *hooks;
+};
+
+#define PEN_ATTR_BIT(attr)  (1U << (attr))
+#define PEN_ALL_ATTRS       (PEN_ATTR_BIT(TICKIT_N_PEN_ATTRS) - 1)
+
+/* Initialise a pen that was not created by tickit_pen_new(), such as one on
+ * the stack. It must not have event hooks bound to it.
+ */
+static inline void pen_init_empty(TickitPen *pen)
+{
+  pen->valid = 0;
+  pen->hooks = NULL;
+}
+
+/* Sets every attribute not present in the pen to its default value */
+static inline void pen_fill_defaults(TickitPen *pen)
+{
+  unsigned int missing = ~pen->valid;
+
+  if(missing & PEN_ATTR_BIT(TICKIT_PEN_FG))      pen->fg      = -1;
+  if(missing & PEN_ATTR_BIT(TICKIT_PEN_BG))      pen->bg      = -1;
+  if(missing & PEN_ATTR_BIT(TICKIT_PEN_BOLD))    pen->bold    = 0;
+  if(missing & PEN_ATTR_BIT(TICKIT_PEN_UNDER))   pen->under   = 0;
+  if(missing & PEN_ATTR_BIT(TICKIT_PEN_ITALIC))  pen->italic  = 0;
+  if(missing & PEN_ATTR_BIT(TICKIT_PEN_REVERSE)) pen->reverse = 0;
+  if(missing & PEN_ATTR_BIT(TICKIT_PEN_STRIKE))  pen->strike  = 0;
+  if(missing & PEN_ATTR_BIT(TICKIT_PEN_ALTFONT)) pen->altfont = -1;
+  if(missing & PEN_ATTR_BIT(TICKIT_PEN_BLINK))   pen->blink   = 0;
+
+  pen->valid = PEN_ALL_ATTRS;
+}
+
+/* Returns the bitmask of attributes present in 'to' which are either absent
+ * from 'from', or have a different value there
+ */
+static inline unsigned int pen_diff_mask(const TickitPen *from, const TickitPen *to)
+{
+  unsigned int differ = 0;
+
+  if(from->fg      != to->fg)      differ |= PEN_ATTR_BIT(TICKIT_PEN_FG);
+  if(from->bg      != to->bg)      differ |= PEN_ATTR_BIT(TICKIT_PEN_BG);
+  if(from->bold    != to->bold)    differ |= PEN_ATTR_BIT(TICKIT_PEN_BOLD);
+  if(from->under   != to->under)   differ |= PEN_ATTR_BIT(TICKIT_PEN_UNDER);
+  if(from->italic  != to->italic)  differ |= PEN_ATTR_BIT(TICKIT_PEN_ITALIC);
+  if(from->reverse != to->reverse) differ |= PEN_ATTR_BIT(TICKIT_PEN_REVERSE);
+  if(from->strike  != to->strike)  differ |= PEN_ATTR_BIT(TICKIT_PEN_STRIKE);
+  if(from->altfont != to->altfont) differ |= PEN_ATTR_BIT(TICKIT_PEN_ALTFONT);
+  if(from->blink   != to->blink)   differ |= PEN_ATTR_BIT(TICKIT_PEN_BLINK);
+
+  return to->valid & (~from->valid | differ);
+}
+
+/* Copies the attributes given by mask from src into dst without invoking
+ * change events
+ */
+static inline void pen_copy_masked(TickitPen *dst, const TickitPen *src, unsigned int mask)
+{
+  if(mask & PEN_ATTR_BIT(TICKIT_PEN_FG))      dst->fg      = src->fg;
+  if(mask & PEN_ATTR_BIT(TICKIT_PEN_BG))      dst->bg      = src->bg;
+  if(mask & PEN_ATTR_BIT(TICKIT_PEN_BOLD))    dst->bold    = src->bold;
+  if(mask & PEN_ATTR_BIT(TICKIT_PEN_UNDER))   dst->under   = src->under;
+  if(mask & PEN_ATTR_BIT(TICKIT_PEN_ITALIC))  dst->italic  = src->italic;
+  if(mask & PEN_ATTR_BIT(TICKIT_PEN_REVERSE)) dst->reverse = src->reverse;
+  if(mask & PEN_ATTR_BIT(TICKIT_PEN_STRIKE))  dst->strike  = src->strike;
+  if(mask & PEN_ATTR_BIT(TICKIT_PEN_ALTFONT)) dst->altfont = src->altfont;
+  if(mask & PEN_ATTR_BIT(TICKIT_PEN_BLINK))   dst->blink   = src->blink;
+
+  dst->valid |= mask;
+}
+
+/* Packs the present attributes of a pen into a single integer, such that
+ * two pens pack equal exactly when they have the same attributes present
+ * with the same values
+ */
+static inline uint64_t pen_pack(const TickitPen *pen)
+{
+  unsigned int valid = pen->valid;
+  uint64_t packed = (uint64_t)valid << 32;
+
+  if(valid & PEN_ATTR_BIT(TICKIT_PEN_FG))      packed |= (uint64_t)(pen->fg & 0x1ff);
+  if(valid & PEN_ATTR_BIT(TICKIT_PEN_BG))      packed |= (uint64_t)(pen->bg & 0x1ff) << 9;
+  if(valid & PEN_ATTR_BIT(TICKIT_PEN_BOLD))    packed |= (uint64_t)pen->bold    << 18;
+  if(valid & PEN_ATTR_BIT(TICKIT_PEN_UNDER))   packed |= (uint64_t)pen->under   << 19;
+  if(valid & PEN_ATTR_BIT(TICKIT_PEN_ITALIC))  packed |= (uint64_t)pen->italic  << 20;
+  if(valid & PEN_ATTR_BIT(TICKIT_PEN_REVERSE)) packed |= (uint64_t)pen->reverse << 21;
+  if(valid & PEN_ATTR_BIT(TICKIT_PEN_STRIKE))  packed |= (uint64_t)pen->strike  << 22;
+  if(valid & PEN_ATTR_BIT(TICKIT_PEN_BLINK))   packed |= (uint64_t)pen->blink   << 23;
+  if(valid & PEN_ATTR_BIT(TICKIT_PEN_ALTFONT)) packed |= (uint64_t)(pen->altfont & 0x1f) << 24;
+
+  return packed;
+}
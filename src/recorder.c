@@ -0,0 +1,346 @@
+/* We need poll(), clock_gettime() and pthreads */
+#define _POSIX_C_SOURCE 200112L
+
+#include "recorder.h"
+#include "spscring.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Each event in the ring is one of these followed by len bytes of data */
+typedef struct {
+  uint64_t nsec; /* since recording started */
+  uint32_t len;
+  char     type; /* 'o' output, 'r' resize, 'm' marker */
+} RecEvent;
+
+struct TickitRecorder {
+  int fd;
+
+  TickitSpscRing ring;
+
+  struct timespec start;
+  size_t dropped; /* events dropped since the last one recorded; producer only */
+
+  pthread_t thread;
+
+  /* The rest belongs to the thread */
+  char  *line;
+  size_t linelen;
+  size_t linesize;
+
+  /* An incomplete UTF-8 sequence at the end of one output event, to be
+   * finished by the next */
+  unsigned char seq[4];
+  int seqlen, seqneed;
+  unsigned char seqmin, seqmax; /* range of the next continuation byte */
+};
+
+static void write_all(int fd, const char *bytes, size_t len)
+{
+  while(len) {
+    ssize_t written = write(fd, bytes, len);
+    if(written < 0) {
+      if(errno == EINTR)
+        continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK) {
+        struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+        poll(&pfd, 1, -1);
+        continue;
+      }
+
+      /* Any other error; the recording is lost */
+      return;
+    }
+
+    bytes += written;
+    len   -= written;
+  }
+}
+
+static void line_cat(TickitRecorder *rec, const char *str, size_t len)
+{
+  if(rec->linesize < rec->linelen + len) {
+    while(rec->linesize < rec->linelen + len)
+      rec->linesize *= 2;
+    rec->line = realloc(rec->line, rec->linesize);
+  }
+
+  memcpy(rec->line + rec->linelen, str, len);
+  rec->linelen += len;
+}
+
+#define line_cats(rec, s) line_cat(rec, s, strlen(s))
+
+static void line_cat_escaped_ascii(TickitRecorder *rec, unsigned char b)
+{
+  char buf[8];
+
+  switch(b) {
+    case '"':  line_cats(rec, "\\\""); return;
+    case '\\': line_cats(rec, "\\\\"); return;
+    case '\n': line_cats(rec, "\\n");  return;
+    case '\r': line_cats(rec, "\\r");  return;
+    case '\t': line_cats(rec, "\\t");  return;
+  }
+
+  if(b < 0x20 || b == 0x7f) {
+    snprintf(buf, sizeof buf, "\\u%04x", b);
+    line_cats(rec, buf);
+  }
+  else
+    line_cat(rec, (char *)&b, 1);
+}
+
+/* JSON strings must be valid UTF-8, so anything that isn't becomes U+FFFD */
+#define REPLACEMENT "\xef\xbf\xbd"
+
+static void line_cat_utf8(TickitRecorder *rec, const unsigned char *bytes, size_t len)
+{
+  for(size_t i = 0; i < len; i++) {
+    unsigned char b = bytes[i];
+
+    if(rec->seqneed) {
+      if(b >= rec->seqmin && b <= rec->seqmax) {
+        rec->seq[rec->seqlen++] = b;
+        rec->seqmin = 0x80;
+        rec->seqmax = 0xbf;
+        if(!--rec->seqneed) {
+          line_cat(rec, (char *)rec->seq, rec->seqlen);
+          rec->seqlen = 0;
+        }
+        continue;
+      }
+
+      /* Truncated sequence; b starts afresh */
+      line_cats(rec, REPLACEMENT);
+      rec->seqlen = rec->seqneed = 0;
+    }
+
+    if(b < 0x80) {
+      line_cat_escaped_ascii(rec, b);
+      continue;
+    }
+
+    rec->seqmin = 0x80;
+    rec->seqmax = 0xbf;
+
+    if(b >= 0xc2 && b <= 0xdf)
+      rec->seqneed = 1;
+    else if(b >= 0xe0 && b <= 0xef) {
+      rec->seqneed = 2;
+      if(b == 0xe0) rec->seqmin = 0xa0; /* overlong */
+      if(b == 0xed) rec->seqmax = 0x9f; /* surrogates */
+    }
+    else if(b >= 0xf0 && b <= 0xf4) {
+      rec->seqneed = 3;
+      if(b == 0xf0) rec->seqmin = 0x90; /* overlong */
+      if(b == 0xf4) rec->seqmax = 0x8f; /* beyond U+10FFFF */
+    }
+    else {
+      line_cats(rec, REPLACEMENT);
+      continue;
+    }
+
+    rec->seq[0] = b;
+    rec->seqlen = 1;
+  }
+}
+
+static void write_event(TickitRecorder *rec, size_t tail)
+{
+  TickitSpscRing *ring = &rec->ring;
+
+  RecEvent ev;
+  tickit_spscring_copy_out(ring, tail, &ev, sizeof ev);
+  tail += sizeof ev;
+
+  char buf[64];
+  snprintf(buf, sizeof buf, "[%llu.%06llu, \"%c\", \"",
+      (unsigned long long)(ev.nsec / 1000000000), (unsigned long long)(ev.nsec % 1000000000 / 1000), ev.type);
+
+  rec->linelen = 0;
+  line_cats(rec, buf);
+  size_t emptylen = rec->linelen;
+
+  /* The data may wrap around the end of the ring */
+  size_t offs = tail & (ring->size - 1);
+  size_t first = ev.len < ring->size - offs ? ev.len : ring->size - offs;
+
+  if(ev.type == 'o') {
+    line_cat_utf8(rec, (unsigned char *)ring->buf + offs, first);
+    line_cat_utf8(rec, (unsigned char *)ring->buf, ev.len - first);
+
+    /* Nothing to show until the rest of a sequence arrives */
+    if(rec->linelen == emptylen)
+      return;
+  }
+  else {
+    for(size_t i = 0; i < ev.len; i++)
+      line_cat_escaped_ascii(rec, ring->buf[(offs + i) & (ring->size - 1)]);
+  }
+
+  line_cats(rec, "\"]\n");
+  write_all(rec->fd, rec->line, rec->linelen);
+}
+
+static void *recorder_main(void *data)
+{
+  TickitRecorder *rec = data;
+  size_t tail = rec->ring.tail;
+
+  while(1) {
+    size_t head = tickit_spscring_wait_data(&rec->ring, tail);
+    if(head == tail)
+      break;
+
+    RecEvent ev;
+    tickit_spscring_copy_out(&rec->ring, tail, &ev, sizeof ev);
+
+    write_event(rec, tail);
+
+    tail += sizeof ev + ev.len;
+    tickit_spscring_consume(&rec->ring, tail);
+  }
+
+  return NULL;
+}
+
+TickitRecorder *tickit_recorder_new(int fd, size_t size, int lines, int cols, const char *termtype)
+{
+  TickitRecorder *rec = malloc(sizeof(TickitRecorder));
+  if(!rec)
+    return NULL;
+
+  rec->linesize = 256;
+  rec->line = malloc(rec->linesize);
+  if(!rec->line) {
+    free(rec);
+    return NULL;
+  }
+
+  if(!tickit_spscring_init(&rec->ring, size)) {
+    free(rec->line);
+    free(rec);
+    return NULL;
+  }
+
+  rec->fd = fd;
+  rec->dropped = 0;
+  rec->linelen = 0;
+  rec->seqlen = rec->seqneed = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &rec->start);
+
+  /* The header line; written here, before the thread exists. Room for the
+   * widest possible values of each number */
+  char buf[128];
+  snprintf(buf, sizeof buf, "{\"version\": 2, \"width\": %d, \"height\": %d, \"timestamp\": %lld",
+      cols, lines, (long long)time(NULL));
+  line_cats(rec, buf);
+  if(termtype) {
+    line_cats(rec, ", \"env\": {\"TERM\": \"");
+    for(const char *s = termtype; *s; s++)
+      line_cat_escaped_ascii(rec, *s);
+    line_cats(rec, "\"}");
+  }
+  line_cats(rec, "}\n");
+  write_all(fd, rec->line, rec->linelen);
+
+  if(pthread_create(&rec->thread, NULL, recorder_main, rec) != 0) {
+    tickit_spscring_fini(&rec->ring);
+    free(rec->line);
+    free(rec);
+    return NULL;
+  }
+
+  return rec;
+}
+
+void tickit_recorder_destroy(TickitRecorder *rec)
+{
+  tickit_spscring_stop(&rec->ring);
+
+  pthread_join(rec->thread, NULL);
+
+  tickit_spscring_fini(&rec->ring);
+  free(rec->line);
+  free(rec);
+}
+
+/* Returns false if there was no room for it */
+static bool push_event(TickitRecorder *rec, char type, const struct iovec *iov, int iovcnt)
+{
+  size_t len = 0;
+  for(int i = 0; i < iovcnt; i++)
+    len += iov[i].iov_len;
+
+  TickitSpscRing *ring = &rec->ring;
+
+  if(sizeof(RecEvent) + len > tickit_spscring_room(ring))
+    return false;
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+
+  RecEvent ev = {
+    .nsec = (uint64_t)(now.tv_sec - rec->start.tv_sec) * 1000000000 + now.tv_nsec - rec->start.tv_nsec,
+    .len  = len,
+    .type = type,
+  };
+
+  size_t head = ring->head;
+  tickit_spscring_copy_in(ring, head, &ev, sizeof ev);
+  head += sizeof ev;
+
+  for(int i = 0; i < iovcnt; i++) {
+    tickit_spscring_copy_in(ring, head, iov[i].iov_base, iov[i].iov_len);
+    head += iov[i].iov_len;
+  }
+
+  tickit_spscring_publish(ring, head);
+
+  return true;
+}
+
+static bool push_event_str(TickitRecorder *rec, char type, const char *str)
+{
+  return push_event(rec, type, &(struct iovec){ (void *)str, strlen(str) }, 1);
+}
+
+/* Marks where output went missing, so a replay isn't trusted past it */
+static bool push_dropped(TickitRecorder *rec)
+{
+  if(!rec->dropped)
+    return true;
+
+  char buf[48];
+  snprintf(buf, sizeof buf, "dropped %zu events", rec->dropped);
+  if(!push_event_str(rec, 'm', buf))
+    return false;
+
+  rec->dropped = 0;
+  return true;
+}
+
+void tickit_recorder_output(TickitRecorder *rec, const struct iovec *iov, int iovcnt)
+{
+  if(!push_dropped(rec) || !push_event(rec, 'o', iov, iovcnt))
+    rec->dropped++;
+}
+
+void tickit_recorder_resize(TickitRecorder *rec, int lines, int cols)
+{
+  char buf[32];
+  snprintf(buf, sizeof buf, "%dx%d", cols, lines);
+
+  if(!push_dropped(rec) || !push_event_str(rec, 'r', buf))
+    rec->dropped++;
+}
@@ -0,0 +1,18 @@
+#include "tickit.h"
+
+#include <sys/uio.h>
+
+/* Records terminal output and resizes as an asciicast v2 file, written by a
+ * background thread from a ring buffer of events. Recording never waits for
+ * room; events that do not fit are dropped, and a marker event says how many
+ * before the next one. Only the thread that created it may call the
+ * functions below.
+ */
+typedef struct TickitRecorder TickitRecorder;
+
+TickitRecorder *tickit_recorder_new(int fd, size_t size, int lines, int cols, const char *termtype);
+/* Waits for every event already recorded to be written */
+void tickit_recorder_destroy(TickitRecorder *rec);
+
+void tickit_recorder_output(TickitRecorder *rec, const struct iovec *iov, int iovcnt);
+void tickit_recorder_resize(TickitRecorder *rec, int lines, int cols);
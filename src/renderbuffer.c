@@ -2,11 +2,15 @@
 #define _XOPEN_SOURCE 600
 
 #include "tickit.h"
+#include "pen.h"
+#include "term.h"
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "linechars.inc"
+#include "xterm-palette.inc"
 
 /* must match .pm file */
 enum TickitRenderBufferCellState {
@@ -16,6 +20,7 @@ enum TickitRenderBufferCellState {
   CONT  = 3,
   LINE  = 4,
   CHAR  = 5,
+  BRAILLE = 6,
 };
 
 enum {
@@ -30,14 +35,37 @@ typedef struct {
   enum TickitRenderBufferCellState state;
   int len; // or "startcol" for state == CONT
   int maskdepth; // -1 if not masked
-  TickitPen *pen; // state -> {TEXT, ERASE, LINE, CHAR}
+  TickitPen *pen; // state -> {TEXT, ERASE, LINE, CHAR, BRAILLE}
   union {
     struct { int idx; int offs; } text; // state == TEXT
     struct { int mask;          } line; // state == LINE
     struct { int codepoint;     } chr;  // state == CHAR
+    struct { int mask;          } braille; // state == BRAILLE
   } v;
 } RBCell;
 
+// A run of cells output by one pen change, collected for reordering on flush
+typedef struct {
+  int line, col, endcol;
+  TickitPen *pen; // borrowed from the cell
+  int group;
+} RBSpan;
+
+// What a cell on the terminal shows, as far as TICKIT_RENDERBUFFER_FLUSH_DIFF
+// knows. The references are borrowed from the cells and texts, so are only
+// valid during the flush that created them
+#define SHADOW_TEXT_MAX 12
+
+typedef struct {
+  enum { SH_UNKNOWN, SH_GLYPH, SH_CONT, SH_ERASE, SH_SKIP } kind;
+  unsigned char width; // kind == SH_GLYPH
+  size_t len;          // kind == SH_GLYPH
+  char text[SHADOW_TEXT_MAX]; // valid if len <= SHADOW_TEXT_MAX
+  uint64_t pen;        // pen_pack() of the pen
+  const char *textref;
+  TickitPen *penref;
+} RBShadowCell;
+
 typedef struct RBStack RBStack;
 struct RBStack {
   RBStack *prev;
@@ -69,6 +97,17 @@ struct TickitRenderBuffer {
   char *tmp;
   size_t tmplen;  // actually valid
   size_t tmpsize; // allocated size
+
+  TickitRenderBufferFlushFlags flush_flags;
+
+  RBSpan *spans;
+  size_t n_spans;    // number actually valid
+  size_t size_spans; // size of allocated buffer
+
+  RBShadowCell *shadow;     // lines * cols, or NULL if no previous frame
+  RBShadowCell *shadow_new; // cols, the line being flushed
+  TickitTerm *shadow_tt;    // what shadow was drawn to
+  unsigned int shadow_serial; // and its display serial at the time
 };
 
 static void free_stack(RBStack *stack)
@@ -138,6 +177,7 @@ static void cont_cell(RBCell *cell, int startcol)
     case ERASE:
     case LINE:
     case CHAR:
+    case BRAILLE:
       tickit_pen_destroy(cell->pen);
       break;
     case SKIP:
@@ -184,6 +224,7 @@ static RBCell *make_span(TickitRenderBuffer *rb, int line, int col, int len)
         break;
       case LINE:
       case CHAR:
+      case BRAILLE:
       case CONT:
         abort();
     }
@@ -207,6 +248,7 @@ static RBCell *make_span(TickitRenderBuffer *rb, int line, int col, int len)
         break;
       case LINE:
       case CHAR:
+      case BRAILLE:
       case CONT:
         abort();
     }
@@ -251,6 +293,17 @@ static void tmp_cat_utf8(TickitRenderBuffer *rb, long codepoint)
   /* rb->tmp remains NOT nul-terminated */
 }
 
+static void tmp_cat_bytes(TickitRenderBuffer *rb, const char *str, size_t len)
+{
+  while(rb->tmpsize < rb->tmplen + len) {
+    rb->tmpsize *= 2;
+    rb->tmp = realloc(rb->tmp, rb->tmpsize);
+  }
+
+  memcpy(rb->tmp + rb->tmplen, str, len);
+  rb->tmplen += len;
+}
+
 TickitRenderBuffer *tickit_renderbuffer_new(int lines, int cols)
 {
   TickitRenderBuffer *rb = malloc(sizeof(TickitRenderBuffer));
@@ -294,6 +347,17 @@ TickitRenderBuffer *tickit_renderbuffer_new(int lines, int cols)
   rb->tmp = malloc(rb->tmpsize);
   rb->tmplen = 0;
 
+  rb->flush_flags = 0;
+
+  rb->n_spans = 0;
+  rb->size_spans = 0;
+  rb->spans = NULL;
+
+  rb->shadow = NULL;
+  rb->shadow_new = NULL;
+  rb->shadow_tt = NULL;
+  rb->shadow_serial = 0;
+
   return rb;
 }
 
@@ -307,6 +371,7 @@ void tickit_renderbuffer_destroy(TickitRenderBuffer *rb)
         case ERASE:
         case LINE:
         case CHAR:
+        case BRAILLE:
           tickit_pen_destroy(cell->pen);
           break;
         case SKIP:
@@ -331,6 +396,11 @@ void tickit_renderbuffer_destroy(TickitRenderBuffer *rb)
 
   free(rb->tmp);
 
+  free(rb->spans);
+
+  free(rb->shadow);
+  free(rb->shadow_new);
+
   free(rb);
 }
 
@@ -437,18 +507,9 @@ void tickit_renderbuffer_setpen(TickitRenderBuffer *rb, TickitPen *pen)
   }
 }
 
-void tickit_renderbuffer_reset(TickitRenderBuffer *rb)
+/* Resets the drawing state, but not the stored content */
+static void reset_state(TickitRenderBuffer *rb)
 {
-  for(int line = 0; line < rb->lines; line++) {
-    // cont_cell also frees pen
-    for(int col = 0; col < rb->cols; col++)
-      cont_cell(&rb->cells[line][col], 0);
-
-    rb->cells[line][0].state     = SKIP;
-    rb->cells[line][0].maskdepth = -1;
-    rb->cells[line][0].len       = rb->cols;
-  }
-
   rb->vc_pos_set = 0;
 
   rb->xlate_line = 0;
@@ -466,6 +527,21 @@ void tickit_renderbuffer_reset(TickitRenderBuffer *rb)
     rb->stack = NULL;
     rb->depth = 0;
   }
+}
+
+void tickit_renderbuffer_reset(TickitRenderBuffer *rb)
+{
+  for(int line = 0; line < rb->lines; line++) {
+    // cont_cell also frees pen
+    for(int col = 0; col < rb->cols; col++)
+      cont_cell(&rb->cells[line][col], 0);
+
+    rb->cells[line][0].state     = SKIP;
+    rb->cells[line][0].maskdepth = -1;
+    rb->cells[line][0].len       = rb->cols;
+  }
+
+  reset_state(rb);
 
   free_texts(rb);
 }
@@ -738,6 +814,102 @@ void tickit_renderbuffer_char(TickitRenderBuffer *rb, long codepoint, TickitPen
   rb->vc_col += 1;
 }
 
+/* Maps RGB colours to xterm256 palette indexes, indexed by the top 5 bits of
+ * each channel. Only the 6x6x6 cube and the grey ramp are candidates, as the
+ * lower 16 colours are commonly redefined by the user. Built on first use,
+ * by whichever thread gets there first.
+ */
+static unsigned char rgb555_to_xterm256[32*32*32];
+static pthread_once_t rgb555_to_xterm256_once = PTHREAD_ONCE_INIT;
+
+static void build_rgb555_to_xterm256(void)
+{
+  for(int i = 0; i < 32*32*32; i++) {
+    // Widen each 5-bit channel back to 8 bits so that 0x1f becomes 0xff
+    int r = (i >> 10) & 0x1f; r = (r << 3) | (r >> 2);
+    int g = (i >>  5) & 0x1f; g = (g << 3) | (g >> 2);
+    int b = (i      ) & 0x1f; b = (b << 3) | (b >> 2);
+
+    int best = 16, bestdist = -1;
+    for(int index = 16; index < 256; index++) {
+      int dr = r - xterm256[index].r;
+      int dg = g - xterm256[index].g;
+      int db = b - xterm256[index].b;
+      int dist = dr*dr + dg*dg + db*db;
+
+      if(bestdist == -1 || dist < bestdist) {
+        best = index;
+        bestdist = dist;
+      }
+    }
+
+    rgb555_to_xterm256[i] = best;
+  }
+}
+
+static inline int rgb_to_xterm256(const unsigned char *rgb)
+{
+  return rgb555_to_xterm256[(rgb[0] >> 3) << 10 | (rgb[1] >> 3) << 5 | (rgb[2] >> 3)];
+}
+
+void tickit_renderbuffer_rgb_at(TickitRenderBuffer *rb, int line, int col, int width, int height,
+    const unsigned char *rgb, size_t stride, TickitPen *pen)
+{
+  pthread_once(&rgb555_to_xterm256_once, build_rgb555_to_xterm256);
+
+  if(!stride)
+    stride = width * 3;
+
+  TickitPen *cellpen = tickit_pen_new();
+  if(pen)
+    tickit_pen_copy(cellpen, pen, 1);
+
+  // Each cell is drawn as U+2580 UPPER HALF BLOCK, with the top pixel as the
+  // foreground and the bottom pixel as the background
+  for(int y = 0; y < height; y += 2, line++) {
+    const unsigned char *top    = rgb + y * stride;
+    const unsigned char *bottom = y + 1 < height ? top + stride : NULL;
+
+    for(int x = 0; x < width; /**/) {
+      int fg = rgb_to_xterm256(top + x*3);
+      int bg = bottom ? rgb_to_xterm256(bottom + x*3) : -1;
+
+      if(fg == bg) {
+        // A run of solid cells is cheaper as an erase of that background
+        int len = 1;
+        while(x + len < width &&
+              rgb_to_xterm256(top    + (x+len)*3) == fg &&
+              rgb_to_xterm256(bottom + (x+len)*3) == fg)
+          len++;
+
+        if(pen && tickit_pen_has_attr(pen, TICKIT_PEN_FG))
+          tickit_pen_copy_attr(cellpen, pen, TICKIT_PEN_FG);
+        else
+          tickit_pen_clear_attr(cellpen, TICKIT_PEN_FG);
+        tickit_pen_set_colour_attr(cellpen, TICKIT_PEN_BG, bg);
+        tickit_renderbuffer_erase_at(rb, line, col + x, len, cellpen);
+
+        x += len;
+        continue;
+      }
+
+      tickit_pen_set_colour_attr(cellpen, TICKIT_PEN_FG, fg);
+      if(bg > -1)
+        tickit_pen_set_colour_attr(cellpen, TICKIT_PEN_BG, bg);
+      else if(pen && tickit_pen_has_attr(pen, TICKIT_PEN_BG))
+        tickit_pen_copy_attr(cellpen, pen, TICKIT_PEN_BG);
+      else
+        tickit_pen_clear_attr(cellpen, TICKIT_PEN_BG);
+
+      tickit_renderbuffer_char_at(rb, line, col + x, 0x2580, cellpen);
+
+      x++;
+    }
+  }
+
+  tickit_pen_destroy(cellpen);
+}
+
 static void linecell(TickitRenderBuffer *rb, int line, int col, int bits, TickitPen *pen)
 {
   int len = 1;
@@ -796,98 +968,913 @@ void tickit_renderbuffer_vline_at(TickitRenderBuffer *rb, int startline, int end
   linecell(rb, endline, col, (caps & TICKIT_LINECAP_END ? south : 0) | north, pen);
 }
 
-void tickit_renderbuffer_flush_to_term(TickitRenderBuffer *rb, TickitTerm *tt)
+/* Braille cells hold a 2x4 grid of dots, indexed [row][column]. Bit values
+ * follow the Unicode dot numbering of U+2800 to U+28FF
+ */
+static const int braille_dot_bits[4][2] = {
+  { 0x01, 0x08 },
+  { 0x02, 0x10 },
+  { 0x04, 0x20 },
+  { 0x40, 0x80 },
+};
+
+/* Division that rounds towards negative infinity, so that dots at negative
+ * coordinates fall in the correct cell
+ */
+static inline int floordiv(int a, int b)
 {
-  for(int line = 0; line < rb->lines; line++) {
-    int phycol = -1; /* column where the terminal cursor physically is */
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
 
-    for(int col = 0; col < rb->cols; /**/) {
-      RBCell *cell = &rb->cells[line][col];
+static void braillecell(TickitRenderBuffer *rb, int dotline, int dotcol, TickitPen *pen)
+{
+  int line = floordiv(dotline, 4);
+  int col  = floordiv(dotcol,  2);
+  int bits = braille_dot_bits[dotline - line*4][dotcol - col*2];
+  int len = 1;
 
-      if(cell->state == SKIP) {
-        col += cell->len;
-        continue;
-      }
+  if(!xlate_and_clip(rb, &line, &col, &len, NULL))
+    return;
 
-      if(phycol < col)
-        tickit_term_goto(tt, line, col);
-      phycol = col;
+  if(rb->cells[line][col].maskdepth > -1)
+    return;
+
+  RBCell *cell = &rb->cells[line][col];
+  if(cell->state != BRAILLE) {
+    make_span(rb, line, col, len);
+    cell->state          = BRAILLE;
+    cell->len            = 1;
+    cell->pen            = tickit_pen_clone(pen);
+    cell->v.braille.mask = 0;
+  }
+  else if(!tickit_pen_equiv(cell->pen, pen)) {
+    tickit_pen_destroy(cell->pen);
+    cell->pen = tickit_pen_clone(pen);
+  }
+
+  cell->v.braille.mask |= bits;
+}
+
+void tickit_renderbuffer_braille_dot_at(TickitRenderBuffer *rb, int dotline, int dotcol, TickitPen *pen)
+{
+  pen = merge_pen(rb, pen);
+
+  braillecell(rb, dotline, dotcol, pen);
+
+  tickit_pen_destroy(pen);
+}
+
+void tickit_renderbuffer_braille_line_at(TickitRenderBuffer *rb, int startdotline, int startdotcol,
+    int enddotline, int enddotcol, TickitPen *pen)
+{
+  pen = merge_pen(rb, pen);
+
+  // Bresenham's line algorithm
+  int dcol  =  abs(enddotcol  - startdotcol);
+  int dline = -abs(enddotline - startdotline);
+  int stepcol  = startdotcol  < enddotcol  ? 1 : -1;
+  int stepline = startdotline < enddotline ? 1 : -1;
+  int err = dcol + dline;
+
+  int dotline = startdotline, dotcol = startdotcol;
+  while(1) {
+    braillecell(rb, dotline, dotcol, pen);
+
+    if(dotline == enddotline && dotcol == enddotcol)
+      break;
+
+    int err2 = 2 * err;
+    if(err2 >= dline) {
+      err     += dline;
+      dotcol  += stepcol;
+    }
+    if(err2 <= dcol) {
+      err     += dcol;
+      dotline += stepline;
+    }
+  }
+
+  tickit_pen_destroy(pen);
+}
+
+void tickit_renderbuffer_blit(TickitRenderBuffer *dst, TickitRenderBuffer *src)
+{
+  for(int line = 0; line < src->lines; line++) {
+    for(int col = 0; col < src->cols; /**/) {
+      RBCell *cell = &src->cells[line][col];
+      int len = cell->len;
 
       switch(cell->state) {
+        case SKIP:
+        case CONT: // should be unreachable
+          break;
+
         case TEXT:
           {
+            char *text = src->texts[cell->v.text.idx];
             TickitStringPos start, end, limit;
-            char *text = rb->texts[cell->v.text.idx];
 
             tickit_stringpos_limit_columns(&limit, cell->v.text.offs);
             tickit_string_count(text, &start, &limit);
-
-            limit.columns += cell->len;
+            tickit_stringpos_limit_columns(&limit, cell->v.text.offs + len);
             end = start;
             tickit_string_countmore(text, &end, &limit);
 
-            tickit_term_setpen(tt, cell->pen);
-            tickit_term_printn(tt, text + start.bytes, end.bytes - start.bytes);
+            // text_at() wants a NUL-terminated string; src->tmp is only
+            // otherwise used while flushing
+            src->tmplen = 0;
+            tmp_cat_bytes(src, text + start.bytes, end.bytes - start.bytes);
+            tmp_cat_bytes(src, "", 1);
 
-            phycol += cell->len;
+            tickit_renderbuffer_text_at(dst, line, col, src->tmp, cell->pen);
+            src->tmplen = 0;
+            break;
           }
-          break;
+
         case ERASE:
+          tickit_renderbuffer_erase_at(dst, line, col, len, cell->pen);
+          break;
+
+        case LINE:
           {
-            /* No need to set moveend=true to erasech unless we actually
-             * have more content */
-            int moveend = col + cell->len < rb->cols &&
-                          rb->cells[line][col + cell->len].state != SKIP;
-
-            tickit_term_setpen(tt, cell->pen);
-            tickit_term_erasech(tt, cell->len, moveend ? TICKIT_YES : TICKIT_MAYBE);
-
-            if(moveend)
-              phycol += cell->len;
-            else
-              phycol = -1;
+            TickitPen *pen = merge_pen(dst, cell->pen);
+            linecell(dst, line, col, cell->v.line.mask, pen);
+            tickit_pen_destroy(pen);
+            break;
           }
+
+        case CHAR:
+          tickit_renderbuffer_char_at(dst, line, col, cell->v.chr.codepoint, cell->pen);
           break;
-        case LINE:
+
+        case BRAILLE:
           {
-            TickitPen *pen = cell->pen;
+            TickitPen *pen = merge_pen(dst, cell->pen);
+            for(int dotline = 0; dotline < 4; dotline++)
+              for(int dotcol = 0; dotcol < 2; dotcol++)
+                if(cell->v.braille.mask & braille_dot_bits[dotline][dotcol])
+                  braillecell(dst, line*4 + dotline, col*2 + dotcol, pen);
+            tickit_pen_destroy(pen);
+            break;
+          }
+      }
 
-            do {
-              tmp_cat_utf8(rb, linemask_to_char[cell->v.line.mask]);
+      col += len;
+    }
+  }
+}
 
-              col++;
-              phycol += cell->len;
-            } while(col < rb->cols &&
-                    (cell = &rb->cells[line][col]) &&
-                    cell->state == LINE &&
-                    tickit_pen_equiv(cell->pen, pen));
+void tickit_renderbuffer_set_flush_flags(TickitRenderBuffer *rb, TickitRenderBufferFlushFlags flags)
+{
+  rb->flush_flags = flags;
 
-            tickit_term_setpen(tt, pen);
-            tickit_term_printn(tt, rb->tmp, rb->tmplen);
+  /* Any previous frame may since have been drawn over */
+  tickit_renderbuffer_invalidate(rb);
+}
+
+void tickit_renderbuffer_invalidate(TickitRenderBuffer *rb)
+{
+  free(rb->shadow);
+  rb->shadow = NULL;
+}
+
+TickitRenderBufferFlushFlags tickit_renderbuffer_get_flush_flags(const TickitRenderBuffer *rb)
+{
+  return rb->flush_flags;
+}
+
+/* Returns the column just after the span starting at the given cell. Runs of
+ * LINE or BRAILLE cells with equivalent pens are output together.
+ */
+static int span_endcol(TickitRenderBuffer *rb, int line, int col)
+{
+  RBCell *cell = &rb->cells[line][col];
+
+  switch(cell->state) {
+    case LINE:
+    case BRAILLE:
+      {
+        enum TickitRenderBufferCellState state = cell->state;
+        TickitPen *pen = cell->pen;
+
+        do
+          col++;
+        while(col < rb->cols &&
+              (cell = &rb->cells[line][col]) &&
+              cell->state == state &&
+              tickit_pen_equiv(cell->pen, pen));
+      }
+      return col;
+
+    default:
+      return col + cell->len;
+  }
+}
+
+/* Runs of at least this many identical characters are candidates for
+ * tickit_term_printrep() when TICKIT_RENDERBUFFER_FLUSH_REPEAT is set */
+#define REPEAT_MIN_RUN 4
+
+/* Prints text, passing runs of a repeated ASCII character to
+ * tickit_term_printrep(). Other characters might be followed by combining
+ * marks, so they are left alone
+ */
+static void print_text_repeated(TickitTerm *tt, const char *str, size_t len)
+{
+  size_t start = 0;
+
+  for(size_t i = 0; i < len; ) {
+    size_t run = 1;
+    while(i + run < len && str[i + run] == str[i])
+      run++;
+
+    if(run >= REPEAT_MIN_RUN && str[i] >= 0x20 && str[i] < 0x7f) {
+      if(i > start)
+        tickit_term_printn_ref(tt, str + start, i - start);
+      tickit_term_printrep(tt, str + i, 1, run);
+      start = i + run;
+    }
+
+    i += run;
+  }
+
+  if(len > start)
+    tickit_term_printn_ref(tt, str + start, len - start);
+}
+
+/* Runs of at least this many line cells that the terminal's alternate
+ * character set can draw are output that way when TICKIT_RENDERBUFFER_FLUSH_ACS
+ * is set */
+#define ACS_MIN_RUN 4
+
+/* Returns the VT100 ACS character that draws the given line mask, or 0 if
+ * there isn't one. It has only single-weight lines with ends on both sides.
+ */
+static char linemask_to_acs(int mask)
+{
+  enum {
+    N = TICKIT_LINE_SINGLE << NORTH_SHIFT,
+    E = TICKIT_LINE_SINGLE << EAST_SHIFT,
+    S = TICKIT_LINE_SINGLE << SOUTH_SHIFT,
+    W = TICKIT_LINE_SINGLE << WEST_SHIFT,
+  };
+
+  switch(mask) {
+    case E|W:     return 'q'; // ─
+    case N|S:     return 'x'; // │
+    case E|S:     return 'l'; // ┌
+    case S|W:     return 'k'; // ┐
+    case N|E:     return 'm'; // └
+    case N|W:     return 'j'; // ┘
+    case N|E|S:   return 't'; // ├
+    case N|S|W:   return 'u'; // ┤
+    case E|S|W:   return 'w'; // ┬
+    case N|E|W:   return 'v'; // ┴
+    case N|E|S|W: return 'n'; // ┼
+  }
+
+  return 0;
+}
+
+/* Outputs the span and updates *phycol to where the terminal cursor is left,
+ * or -1 if it is unknown. The caller must already have moved the cursor
+ * to the start of the span.
+ */
+static void flush_span(TickitRenderBuffer *rb, TickitTerm *tt, int line, int col, int endcol, int *phycol)
+{
+  RBCell *cell = &rb->cells[line][col];
+
+  switch(cell->state) {
+    case TEXT:
+      {
+        TickitStringPos start, end, limit;
+        char *text = rb->texts[cell->v.text.idx];
+
+        tickit_stringpos_limit_columns(&limit, cell->v.text.offs);
+        tickit_string_count(text, &start, &limit);
+
+        limit.columns += cell->len;
+        end = start;
+        tickit_string_countmore(text, &end, &limit);
+
+        tickit_term_setpen(tt, cell->pen);
+        /* rb->texts remain valid until the reset at the end of flushing */
+        if(rb->flush_flags & TICKIT_RENDERBUFFER_FLUSH_REPEAT)
+          print_text_repeated(tt, text + start.bytes, end.bytes - start.bytes);
+        else
+          tickit_term_printn_ref(tt, text + start.bytes, end.bytes - start.bytes);
+      }
+      break;
+    case ERASE:
+      {
+        /* No need to set moveend=true to erasech unless we actually
+         * have more content */
+        int moveend = endcol < rb->cols &&
+                      rb->cells[line][endcol].state != SKIP;
+
+        tickit_term_setpen(tt, cell->pen);
+        tickit_term_erasech(tt, cell->len, moveend ? TICKIT_YES : TICKIT_MAYBE);
+
+        if(!moveend) {
+          *phycol = -1;
+          return;
+        }
+      }
+      break;
+    case LINE:
+      tickit_term_setpen(tt, cell->pen);
+
+      /* Cleared if the terminal turns out not to support it */
+      bool acs = rb->flush_flags & TICKIT_RENDERBUFFER_FLUSH_ACS;
+
+      for(int c = col; c < endcol; ) {
+        int mask = rb->cells[line][c].v.line.mask;
+
+        if(acs) {
+          int acsend = c;
+          while(acsend < endcol && linemask_to_acs(rb->cells[line][acsend].v.line.mask))
+            acsend++;
+
+          if(acsend - c >= ACS_MIN_RUN) {
+            if(rb->tmplen)
+              tickit_term_printn(tt, rb->tmp, rb->tmplen);
             rb->tmplen = 0;
-          }
-          continue; /* col already updated */
-        case CHAR:
-          {
-            tmp_cat_utf8(rb, cell->v.chr.codepoint);
 
-            tickit_term_setpen(tt, cell->pen);
-            tickit_term_printn(tt, rb->tmp, rb->tmplen);
+            for(int i = c; i < acsend; i++) {
+              char acschr = linemask_to_acs(rb->cells[line][i].v.line.mask);
+              tmp_cat_bytes(rb, &acschr, 1);
+            }
+
+            bool done = tickit_term_print_acs(tt, rb->tmp, rb->tmplen);
             rb->tmplen = 0;
 
-            phycol += cell->len;
+            if(done) {
+              c = acsend;
+              continue;
+            }
+            acs = false;
           }
+        }
+
+        int run = 1;
+        while(c + run < endcol && rb->cells[line][c + run].v.line.mask == mask)
+          run++;
+
+        if(run >= REPEAT_MIN_RUN && rb->flush_flags & TICKIT_RENDERBUFFER_FLUSH_REPEAT) {
+          if(rb->tmplen)
+            tickit_term_printn(tt, rb->tmp, rb->tmplen);
+          rb->tmplen = 0;
+
+          tmp_cat_utf8(rb, linemask_to_char[mask]);
+          tickit_term_printrep(tt, rb->tmp, rb->tmplen, run);
+          rb->tmplen = 0;
+        }
+        else
+          for(int i = 0; i < run; i++)
+            tmp_cat_utf8(rb, linemask_to_char[mask]);
+
+        c += run;
+      }
+
+      if(rb->tmplen)
+        tickit_term_printn(tt, rb->tmp, rb->tmplen);
+      rb->tmplen = 0;
+      break;
+    case BRAILLE:
+      for(int c = col; c < endcol; c++)
+        tmp_cat_utf8(rb, 0x2800 | rb->cells[line][c].v.braille.mask);
+
+      tickit_term_setpen(tt, cell->pen);
+      tickit_term_printn(tt, rb->tmp, rb->tmplen);
+      rb->tmplen = 0;
+      break;
+    case CHAR:
+      tmp_cat_utf8(rb, cell->v.chr.codepoint);
+
+      tickit_term_setpen(tt, cell->pen);
+      tickit_term_printn(tt, rb->tmp, rb->tmplen);
+      rb->tmplen = 0;
+      break;
+    case SKIP:
+    case CONT:
+      /* unreachable */
+      abort();
+  }
+
+  *phycol = endcol;
+}
+
+/* Beyond this many distinct pens, grouping is unlikely to help and the cost of
+ * finding the groups grows too large */
+#define MAX_PEN_GROUPS 16
+
+static int digits(int n)
+{
+  int d = 1;
+  while(n >= 10)
+    n /= 10, d++;
+  return d;
+}
+
+/* Approximate byte costs of the control sequences used to move between spans,
+ * assuming an ANSI/xterm-like terminal
+ */
+static int goto_cost(int line, int col)
+{
+  // CSI line ; col H
+  return 4 + digits(line + 1) + digits(col + 1);
+}
+
+static int pen_change_cost(const TickitPen *from, const TickitPen *to)
+{
+  int changed = 0;
+  for(TickitPenAttr attr = 0; attr < TICKIT_N_PEN_ATTRS; attr++)
+    if(!tickit_pen_equiv_attr(from, to, attr))
+      changed++;
+
+  // CSI params m, with roughly 3 bytes per changed parameter
+  return changed ? 2 + 3 * changed : 0;
+}
+
+static int spans_cost(RBSpan *spans, size_t n)
+{
+  int cost = 0;
+
+  for(size_t i = 1; i < n; i++) {
+    RBSpan *prev = &spans[i-1], *this = &spans[i];
+
+    if(this->line != prev->line || this->col != prev->endcol)
+      cost += goto_cost(this->line, this->col);
+    cost += pen_change_cost(prev->pen, this->pen);
+  }
+
+  return cost;
+}
+
+static int spancmp_group(const void *a, const void *b)
+{
+  const RBSpan *x = a, *y = b;
+  if(x->group != y->group)
+    return x->group - y->group;
+  if(x->line != y->line)
+    return x->line - y->line;
+  return x->col - y->col;
+}
+
+static void push_span(TickitRenderBuffer *rb, int line, int col, int endcol)
+{
+  if(rb->n_spans == rb->size_spans) {
+    rb->size_spans = rb->size_spans ? rb->size_spans * 2 : 64;
+    rb->spans = realloc(rb->spans, rb->size_spans * sizeof(RBSpan));
+  }
+
+  RBSpan *span = &rb->spans[rb->n_spans++];
+  span->line   = line;
+  span->col    = col;
+  span->endcol = endcol;
+  span->pen    = rb->cells[line][col].pen;
+  span->group  = -1;
+}
+
+/* Collects every span in linear order and assigns each to a group of spans
+ * having equivalent pens. Returns false if there are too many distinct pens
+ * for grouping to be worthwhile.
+ */
+static bool collect_spans(TickitRenderBuffer *rb)
+{
+  TickitPen *grouppens[MAX_PEN_GROUPS];
+  int n_groups = 0;
+
+  rb->n_spans = 0;
+
+  for(int line = 0; line < rb->lines; line++) {
+    for(int col = 0; col < rb->cols; /**/) {
+      RBCell *cell = &rb->cells[line][col];
+
+      if(cell->state == SKIP) {
+        col += cell->len;
+        continue;
+      }
+
+      int endcol = span_endcol(rb, line, col);
+      push_span(rb, line, col, endcol);
+      col = endcol;
+
+      RBSpan *span = &rb->spans[rb->n_spans - 1];
+      for(int g = 0; g < n_groups; g++)
+        if(tickit_pen_equiv(grouppens[g], span->pen)) {
+          span->group = g;
           break;
-        case SKIP:
-        case CONT:
-          /* unreachable */
-          abort();
+        }
+
+      if(span->group == -1) {
+        if(n_groups == MAX_PEN_GROUPS)
+          return false;
+        grouppens[n_groups] = span->pen;
+        span->group = n_groups++;
       }
+    }
+  }
+
+  return true;
+}
+
+static void flush_grouped(TickitRenderBuffer *rb, TickitTerm *tt)
+{
+  int phyline = -1, phycol = -1;
+
+  for(size_t i = 0; i < rb->n_spans; i++) {
+    RBSpan *span = &rb->spans[i];
+
+    if(phyline != span->line || phycol != span->col)
+      tickit_term_goto(tt, span->line, span->col);
 
-      col += cell->len;
+    phyline = span->line;
+    flush_span(rb, tt, span->line, span->col, span->endcol, &phycol);
+  }
+}
+
+/* Finds where the run of ERASE cells with equivalent pens that continues to
+ * the end of the buffer begins, if it covers more than the last line. Such a
+ * tail can be erased in one go, provided the buffer covers the whole terminal
+ */
+static bool find_erase_tail(TickitRenderBuffer *rb, TickitTerm *tt, int *tailline, int *tailcol)
+{
+  int term_lines, term_cols;
+  tickit_term_get_size(tt, &term_lines, &term_cols);
+  if(rb->lines != term_lines || rb->cols != term_cols)
+    return false;
+
+  int startline = -1, startcol = -1;
+  TickitPen *pen = NULL;
+
+  for(int line = 0; line < rb->lines; line++)
+    for(int col = 0; col < rb->cols; /**/) {
+      RBCell *cell = &rb->cells[line][col];
+
+      if(cell->state != ERASE)
+        startline = -1;
+      else if(startline == -1 || !tickit_pen_equiv(cell->pen, pen)) {
+        startline = line;
+        startcol  = col;
+        pen = cell->pen;
+      }
+
+      col = cell->state == SKIP ? col + cell->len : span_endcol(rb, line, col);
     }
+
+  if(startline == -1 || startline == rb->lines - 1)
+    return false;
+
+  *tailline = startline;
+  *tailcol  = startcol;
+  return true;
+}
+
+/* Horizontal shifts within a line are only worth a scrollrect if at least
+ * this many cells then need not be repainted, and are looked for up to this
+ * many columns */
+#define SHIFT_MIN_MATCH 8
+#define SHIFT_MAX       16
+
+static size_t get_span_text(TickitRenderBuffer *rb, RBCell *span, int offset, int one_grapheme, char *buffer, size_t len);
+
+static void shadow_set_glyph(RBShadowCell *sh, const char *text, size_t len, int width, TickitPen *pen)
+{
+  sh->kind    = SH_GLYPH;
+  sh->width   = width;
+  sh->len     = len;
+  sh->textref = text;
+  if(len <= SHADOW_TEXT_MAX)
+    memmove(sh->text, text, len);
+  sh->penref  = pen;
+  sh->pen     = pen_pack(pen);
+}
+
+/* Fills rb->shadow_new with what the given line of the buffer will show */
+static void build_shadow_line(TickitRenderBuffer *rb, int line)
+{
+  RBShadowCell *new = rb->shadow_new;
+
+  for(int col = 0; col < rb->cols; /**/) {
+    RBCell *cell = &rb->cells[line][col];
+
+    switch(cell->state) {
+      case SKIP:
+        for(int c = col; c < col + cell->len; c++)
+          new[c].kind = SH_SKIP;
+        col += cell->len;
+        break;
+      case ERASE:
+        for(int c = col; c < col + cell->len; c++) {
+          new[c].kind   = SH_ERASE;
+          new[c].penref = cell->pen;
+          new[c].pen    = pen_pack(cell->pen);
+        }
+        col += cell->len;
+        break;
+      case TEXT:
+        {
+          TickitStringPos start, end, limit;
+          char *text = rb->texts[cell->v.text.idx];
+
+          tickit_stringpos_limit_columns(&limit, cell->v.text.offs);
+          tickit_string_count(text, &start, &limit);
+
+          int c = col;
+          while(c < col + cell->len) {
+            end = start;
+            tickit_stringpos_limit_graphemes(&limit, start.graphemes + 1);
+            tickit_string_countmore(text, &end, &limit);
+
+            int width = end.columns - start.columns;
+            if(width < 1 || c + width > col + cell->len)
+              width = 1;
+
+            shadow_set_glyph(&new[c], text + start.bytes, end.bytes - start.bytes, width, cell->pen);
+            for(int i = 1; i < width; i++)
+              new[c + i].kind = SH_CONT;
+
+            c += width;
+            start = end;
+          }
+          col += cell->len;
+        }
+        break;
+      case LINE:
+      case CHAR:
+      case BRAILLE:
+        {
+          /* Each of these is a single-column character */
+          size_t len = get_span_text(rb, cell, 0, 1, new[col].text, SHADOW_TEXT_MAX);
+          shadow_set_glyph(&new[col], new[col].text, len, 1, cell->pen);
+          col++;
+        }
+        break;
+      case CONT:
+        /* unreachable */
+        abort();
+    }
+  }
+}
+
+static bool shadow_eq(const RBShadowCell *a, const RBShadowCell *b)
+{
+  if(a->kind != b->kind)
+    return false;
+
+  switch(a->kind) {
+    case SH_UNKNOWN:
+      return false;
+    case SH_GLYPH:
+      return a->pen == b->pen && a->width == b->width && a->len == b->len &&
+        a->len <= SHADOW_TEXT_MAX && memcmp(a->text, b->text, a->len) == 0;
+    case SH_ERASE:
+      return a->pen == b->pen;
+    case SH_CONT:
+    case SH_SKIP:
+      return true;
   }
 
+  return false;
+}
+
+/* Whether the cells from left to right would match the terminal once its
+ * content there had been shifted rightward by shift columns, or leftward if
+ * shift is negative
+ */
+static bool shift_matches(const RBShadowCell *new, const RBShadowCell *old, int cols, int left, int right, int shift)
+{
+  if(new[left].kind == SH_CONT || old[left].kind == SH_CONT)
+    return false;
+  if(right + 1 < cols && (new[right + 1].kind == SH_CONT || old[right + 1].kind == SH_CONT))
+    return false;
+
+  for(int col = left; col <= right; col++)
+    if(new[col].kind == SH_SKIP)
+      return false;
+
+  if(shift > 0) {
+    for(int col = left + shift; col <= right; col++)
+      if(!shadow_eq(&new[col], &old[col - shift]))
+        return false;
+  }
+  else {
+    for(int col = left; col <= right + shift; col++)
+      if(!shadow_eq(&new[col], &old[col - shift]))
+        return false;
+  }
+
+  return true;
+}
+
+/* Looks for content inserted or deleted within the line, and if found, uses
+ * the terminal to shift the remaining content across so it need not be sent
+ * again. old is updated to match the terminal.
+ */
+static void shift_line(TickitRenderBuffer *rb, TickitTerm *tt, int line, RBShadowCell *old)
+{
+  RBShadowCell *new = rb->shadow_new;
+  int left = -1, right = -1;
+
+  for(int col = 0; col < rb->cols; col++)
+    if(new[col].kind != SH_SKIP && !shadow_eq(&new[col], &old[col])) {
+      if(left == -1)
+        left = col;
+      right = col;
+    }
+
+  if(left == -1)
+    return;
+
+  for(int k = 1; k <= SHIFT_MAX; k++)
+    for(int dir = 1; dir >= -1; dir -= 2) {
+      int shift = k * dir;
+
+      /* Prefer shifting the whole rest of the line, which every terminal
+       * can do, to shifting just the changed region */
+      int shiftright = rb->cols - 1;
+      if(!shift_matches(new, old, rb->cols, left, shiftright, shift)) {
+        shiftright = right;
+        if(!shift_matches(new, old, rb->cols, left, shiftright, shift))
+          continue;
+      }
+
+      if(shiftright - left + 1 - k < SHIFT_MIN_MATCH)
+        continue;
+
+      if(!tickit_term_scrollrect(tt, line, left, 1, shiftright - left + 1, 0, -shift))
+        return;
+
+      if(shift > 0) {
+        memmove(old + left + k, old + left, (shiftright - left + 1 - k) * sizeof(RBShadowCell));
+        for(int col = left; col < left + k; col++)
+          old[col].kind = SH_UNKNOWN;
+      }
+      else {
+        memmove(old + left, old + left + k, (shiftright - left + 1 - k) * sizeof(RBShadowCell));
+        for(int col = shiftright + 1 - k; col <= shiftright; col++)
+          old[col].kind = SH_UNKNOWN;
+      }
+      return;
+    }
+}
+
+/* Outputs only those cells of the line that differ from what the terminal
+ * is known to show, then records what it now shows
+ */
+static void flush_line_diff(TickitRenderBuffer *rb, TickitTerm *tt, int line, RBShadowCell *old)
+{
+  RBShadowCell *new = rb->shadow_new;
+  int phycol = -1;
+
+  for(int col = 0; col < rb->cols; /**/) {
+    RBShadowCell *sh = &new[col];
+
+    if(sh->kind == SH_SKIP || sh->kind == SH_CONT || shadow_eq(sh, &old[col])) {
+      col++;
+      continue;
+    }
+
+    if(phycol != col)
+      tickit_term_goto(tt, line, col);
+
+    if(sh->kind == SH_ERASE) {
+      int endcol = col + 1;
+      while(endcol < rb->cols && new[endcol].kind == SH_ERASE &&
+            new[endcol].pen == sh->pen && !shadow_eq(&new[endcol], &old[endcol]))
+        endcol++;
+
+      tickit_term_setpen(tt, sh->penref);
+      if(endcol < rb->cols) {
+        tickit_term_erasech(tt, endcol - col, TICKIT_YES);
+        phycol = endcol;
+      }
+      else {
+        tickit_term_erasech(tt, endcol - col, TICKIT_MAYBE);
+        phycol = -1;
+      }
+      col = endcol;
+    }
+    else {
+      /* Print the run of changed glyphs sharing this pen in one go */
+      int endcol = col;
+      while(endcol < rb->cols && new[endcol].kind == SH_GLYPH &&
+            new[endcol].pen == sh->pen && !shadow_eq(&new[endcol], &old[endcol])) {
+        tmp_cat_bytes(rb, new[endcol].textref, new[endcol].len);
+        endcol += new[endcol].width;
+      }
+
+      tickit_term_setpen(tt, sh->penref);
+      tickit_term_printn(tt, rb->tmp, rb->tmplen);
+      rb->tmplen = 0;
+      phycol = endcol;
+      col = endcol;
+    }
+  }
+
+  for(int col = 0; col < rb->cols; col++) {
+    if(new[col].kind == SH_SKIP)
+      continue;
+
+    old[col] = new[col];
+    /* Texts too long to copy can't be compared next time */
+    if(old[col].kind == SH_GLYPH && old[col].len > SHADOW_TEXT_MAX)
+      old[col].kind = SH_UNKNOWN;
+  }
+}
+
+static void flush_diff(TickitRenderBuffer *rb, TickitTerm *tt)
+{
+  /* A different terminal, or one whose screen has changed under us */
+  if(rb->shadow_tt != tt || rb->shadow_serial != tickit_term_display_serial(tt))
+    tickit_renderbuffer_invalidate(rb);
+
+  rb->shadow_tt = tt;
+  rb->shadow_serial = tickit_term_display_serial(tt);
+
+  if(!rb->shadow) {
+    rb->shadow = malloc(rb->lines * rb->cols * sizeof(RBShadowCell));
+    for(int i = 0; i < rb->lines * rb->cols; i++)
+      rb->shadow[i].kind = SH_UNKNOWN;
+  }
+  if(!rb->shadow_new)
+    rb->shadow_new = malloc(rb->cols * sizeof(RBShadowCell));
+
+  for(int line = 0; line < rb->lines; line++) {
+    RBShadowCell *old = rb->shadow + line * rb->cols;
+
+    build_shadow_line(rb, line);
+    shift_line(rb, tt, line, old);
+    flush_line_diff(rb, tt, line, old);
+  }
+}
+
+void tickit_renderbuffer_flush_to_term(TickitRenderBuffer *rb, TickitTerm *tt)
+{
+  /* Keep the content so the next frame is drawn over it, merging the two */
+  if(rb->flush_flags & TICKIT_RENDERBUFFER_FLUSH_MERGE_CONGESTED &&
+      tickit_term_is_congested(tt)) {
+    for(int line = 0; line < rb->lines; line++)
+      for(int col = 0; col < rb->cols; col++)
+        rb->cells[line][col].maskdepth = -1;
+
+    reset_state(rb);
+    return;
+  }
+
+  if(rb->flush_flags & TICKIT_RENDERBUFFER_FLUSH_DIFF) {
+    flush_diff(rb, tt);
+    goto done;
+  }
+
+  if(rb->flush_flags & TICKIT_RENDERBUFFER_FLUSH_GROUP_PENS &&
+      collect_spans(rb)) {
+    int linear_cost = spans_cost(rb->spans, rb->n_spans);
+
+    qsort(rb->spans, rb->n_spans, sizeof(RBSpan), spancmp_group);
+
+    if(spans_cost(rb->spans, rb->n_spans) < linear_cost) {
+      flush_grouped(rb, tt);
+      goto done;
+    }
+  }
+
+  int tailline, tailcol;
+  if(!find_erase_tail(rb, tt, &tailline, &tailcol))
+    tailline = tailcol = -1;
+
+  for(int line = 0; line < rb->lines; line++) {
+    int phycol = -1; /* column where the terminal cursor physically is */
+
+    for(int col = 0; col < rb->cols; /**/) {
+      RBCell *cell = &rb->cells[line][col];
+
+      if(cell->state == SKIP) {
+        col += cell->len;
+        continue;
+      }
+
+      if(phycol < col)
+        tickit_term_goto(tt, line, col);
+
+      if(line == tailline && col == tailcol) {
+        tickit_term_setpen(tt, cell->pen);
+        if(tickit_term_erase_below(tt))
+          goto done;
+      }
+
+      int endcol = span_endcol(rb, line, col);
+      flush_span(rb, tt, line, col, endcol, &phycol);
+      col = endcol;
+    }
+  }
+
+done:
+  /* Vectored output may still refer to our text, which reset will free */
+  if(tickit_term_get_output_vectored(tt))
+    tickit_term_release_refs(tt);
+
   tickit_renderbuffer_reset(rb);
 }
 
@@ -951,6 +1938,10 @@ static size_t get_span_text(TickitRenderBuffer *rb, RBCell *span, int offset, in
     case CHAR:
       bytes = tickit_string_putchar(buffer, len, span->v.chr.codepoint);
       break;
+
+    case BRAILLE:
+      bytes = tickit_string_putchar(buffer, len, 0x2800 | span->v.braille.mask);
+      break;
   }
 
   if(buffer && len > bytes)
@@ -0,0 +1,125 @@
+/* We need pthreads */
+#define _POSIX_C_SOURCE 200112L
+
+#include "spscring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* Every access to a field shared between the two threads goes through these.
+ * They are sequentially consistent so that a thread going to sleep and the
+ * other one waking it cannot miss each other
+ */
+#define LOAD(p)     __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define STORE(p, v) __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+
+bool tickit_spscring_init(TickitSpscRing *ring, size_t size)
+{
+  ring->size = 1024;
+  while(ring->size < size)
+    ring->size *= 2;
+
+  ring->buf = malloc(ring->size);
+  if(!ring->buf)
+    return false;
+
+  ring->head = ring->tail = 0;
+  ring->consumer_waiting = ring->producer_waiting = ring->stopping = 0;
+
+  pthread_mutex_init(&ring->mutex, NULL);
+  pthread_cond_init(&ring->cond, NULL);
+
+  return true;
+}
+
+void tickit_spscring_fini(TickitSpscRing *ring)
+{
+  pthread_cond_destroy(&ring->cond);
+  pthread_mutex_destroy(&ring->mutex);
+  free(ring->buf);
+}
+
+static void wake(TickitSpscRing *ring, int *waiting)
+{
+  if(!LOAD(waiting))
+    return;
+
+  pthread_mutex_lock(&ring->mutex);
+  STORE(waiting, 0);
+  pthread_cond_signal(&ring->cond);
+  pthread_mutex_unlock(&ring->mutex);
+}
+
+size_t tickit_spscring_room(TickitSpscRing *ring)
+{
+  return ring->size - (ring->head - LOAD(&ring->tail));
+}
+
+void tickit_spscring_wait_room(TickitSpscRing *ring, size_t len)
+{
+  while(len > tickit_spscring_room(ring)) {
+    pthread_mutex_lock(&ring->mutex);
+    STORE(&ring->producer_waiting, 1);
+    while(LOAD(&ring->producer_waiting) && len > tickit_spscring_room(ring))
+      pthread_cond_wait(&ring->cond, &ring->mutex);
+    STORE(&ring->producer_waiting, 0);
+    pthread_mutex_unlock(&ring->mutex);
+  }
+}
+
+void tickit_spscring_copy_in(TickitSpscRing *ring, size_t head, const void *bytes, size_t len)
+{
+  size_t offs = head & (ring->size - 1);
+  size_t first = len < ring->size - offs ? len : ring->size - offs;
+
+  memcpy(ring->buf + offs, bytes, first);
+  memcpy(ring->buf, (const char *)bytes + first, len - first);
+}
+
+void tickit_spscring_publish(TickitSpscRing *ring, size_t head)
+{
+  STORE(&ring->head, head);
+  wake(ring, &ring->consumer_waiting);
+}
+
+void tickit_spscring_stop(TickitSpscRing *ring)
+{
+  STORE(&ring->stopping, 1);
+  wake(ring, &ring->consumer_waiting);
+}
+
+size_t tickit_spscring_wait_data(TickitSpscRing *ring, size_t tail)
+{
+  while(1) {
+    size_t head = LOAD(&ring->head);
+    if(head != tail || LOAD(&ring->stopping))
+      return head;
+
+    pthread_mutex_lock(&ring->mutex);
+    STORE(&ring->consumer_waiting, 1);
+    while(LOAD(&ring->consumer_waiting) && LOAD(&ring->head) == tail && !LOAD(&ring->stopping))
+      pthread_cond_wait(&ring->cond, &ring->mutex);
+    STORE(&ring->consumer_waiting, 0);
+    pthread_mutex_unlock(&ring->mutex);
+  }
+}
+
+void tickit_spscring_copy_out(TickitSpscRing *ring, size_t tail, void *dest, size_t len)
+{
+  size_t offs = tail & (ring->size - 1);
+  size_t first = len < ring->size - offs ? len : ring->size - offs;
+
+  memcpy(dest, ring->buf + offs, first);
+  memcpy((char *)dest + first, ring->buf, len - first);
+}
+
+void tickit_spscring_consume(TickitSpscRing *ring, size_t tail)
+{
+  STORE(&ring->tail, tail);
+  wake(ring, &ring->producer_waiting);
+}
+
+size_t tickit_spscring_pending(TickitSpscRing *ring)
+{
+  return LOAD(&ring->head) - LOAD(&ring->tail);
+}
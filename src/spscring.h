@@ -0,0 +1,52 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+/* A single-producer/single-consumer byte ring shared between the thread that
+ * owns a terminal and a background thread draining it, as used by
+ * TickitTermWriter and TickitRecorder. The ring itself is lock-free; the
+ * mutex and condition are only for a thread that has nothing to do to sleep
+ * on.
+ */
+typedef struct {
+  char  *buf;
+  size_t size; /* a power of two */
+
+  /* Running totals, so head - tail is the number of bytes in the ring. Each
+   * is only ever stored by one thread, and read by the other through
+   * tickit_spscring_room(), _wait_data() or _pending() */
+  size_t head; /* bytes queued by the producer */
+  size_t tail; /* bytes taken by the consumer */
+
+  pthread_mutex_t mutex;
+  pthread_cond_t  cond;
+  int consumer_waiting;
+  int producer_waiting;
+  int stopping;
+} TickitSpscRing;
+
+/* Rounds size up to a power of two, of at least 1024 bytes */
+bool tickit_spscring_init(TickitSpscRing *ring, size_t size);
+void tickit_spscring_fini(TickitSpscRing *ring);
+
+/* Producer side */
+size_t tickit_spscring_room(TickitSpscRing *ring);
+/* Sleeps until there are at least len bytes of room */
+void tickit_spscring_wait_room(TickitSpscRing *ring, size_t len);
+/* Copies into the ring at head, which the caller has made room for */
+void tickit_spscring_copy_in(TickitSpscRing *ring, size_t head, const void *bytes, size_t len);
+/* Makes everything up to head visible to the consumer */
+void tickit_spscring_publish(TickitSpscRing *ring, size_t head);
+/* Asks the consumer to finish once the ring is empty */
+void tickit_spscring_stop(TickitSpscRing *ring);
+
+/* Consumer side */
+/* Returns the producer's head, sleeping while the ring is empty at tail; if
+ * that is still tail, the producer has called _stop() */
+size_t tickit_spscring_wait_data(TickitSpscRing *ring, size_t tail);
+void tickit_spscring_copy_out(TickitSpscRing *ring, size_t tail, void *dest, size_t len);
+/* Releases everything before tail back to the producer */
+void tickit_spscring_consume(TickitSpscRing *ring, size_t tail);
+
+/* Either side */
+size_t tickit_spscring_pending(TickitSpscRing *ring);
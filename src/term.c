@@ -7,11 +7,17 @@
 #include "tickit.h"
 
 #include "hooklists.h"
+#include "iouring.h"
+#include "pen.h"
+#include "recorder.h"
+#include "term.h"
 #include "termdriver.h"
+#include "termwriter.h"
 
 #include "xterm-palette.inc"
 
 #include <errno.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -21,6 +27,20 @@
 #include <sys/ioctl.h>
 #include <sys/select.h>
 #include <sys/time.h>
+#include <sys/uio.h>
+
+/* Vectored output; fragments from tickit_term_printn_ref() at least this long
+ * are referenced in place rather than copied into the output buffer */
+#define OUTIOV_INITIAL 64
+#define OUTREF_MIN  32
+#define OUTVECTORED_DEFAULT_BUFFER 4096
+
+#ifndef IOV_MAX
+# define IOV_MAX 1024
+#endif
+
+/* Buffer size used for a frame when no output buffer was set */
+#define FRAME_DEFAULT_BUFFER 4096
 
 /* unit multipliers for working in microseconds */
 #define MSEC      1000
@@ -38,6 +58,8 @@ struct TickitTerm {
   int                   outfd;
   TickitTermOutputFunc *outfunc;
   void                 *outfunc_user;
+  TickitTermOutputVFunc *outvfunc;
+  void                  *outvfunc_user;
 
   int                   infd;
   TermKey              *termkey;
@@ -50,14 +72,48 @@ struct TickitTerm {
   size_t outbuffer_len; /* size of outbuffer */
   size_t outbuffer_cur; /* current fill level */
 
+  bool outvectored;
+  struct iovec *outiov;
+  int outiov_cnt;
+  int outiov_size; /* allocated size of outiov */
+  const char *outref_start, *outref_end; /* range of a printn_ref() string */
+
   char *tmpbuffer;
   size_t tmpbuffer_len;
 
+  /* Kept apart from tmpbuffer, which may hold the very text being output */
+  char *resbuffer;
+  size_t resbuffer_len;
+  bool reserved_out; /* the last reserve_output() was in outbuffer, not resbuffer */
+
+  char *outqueue; /* bytes not yet accepted by a non-blocking outfd */
+  size_t outqueue_len;  /* number of bytes queued */
+  size_t outqueue_size; /* allocated size of outqueue */
+
+  size_t outlimit; /* 0 if congestion is not tracked */
+
+  TickitTermWriter *writer; /* NULL unless outfd is written by a thread */
+  size_t writer_size;       /* 0 if no thread was requested */
+  TickitTermWriterPolicy writer_policy;
+  size_t outdropped; /* bytes the writer had no room for */
+  bool   outdropping; /* dropping the rest of the current frame */
+
+  struct TickitIOUringTerm *iouring; /* NULL unless I/O goes via a TickitIOUring */
+
+  TickitRecorder *recorder;
+
+  int frame_depth;
+  bool frame_buffer; /* outbuffer was created only for the current frame */
+
+  unsigned int display_serial; /* bumped when the screen content is unknown */
+
   TickitTermDriver *driver;
 
   int lines;
   int cols;
 
+  int cursor_line, cursor_col; /* -1 if unknown */
+
   enum { UNSTARTED, STARTING, STARTED } state;
 
   int colors;
@@ -126,6 +182,7 @@ TickitTerm *tickit_term_new_for_driver(TickitTermDriver *ttd)
 
   tt->outfd   = -1;
   tt->outfunc = NULL;
+  tt->outvfunc = NULL;
 
   tt->infd    = -1;
   tt->termkey = NULL;
@@ -135,15 +192,47 @@ TickitTerm *tickit_term_new_for_driver(TickitTermDriver *ttd)
   tt->outbuffer_len = 0;
   tt->outbuffer_cur = 0;
 
+  tt->outvectored = false;
+  tt->outiov = NULL;
+  tt->outiov_cnt = 0;
+  tt->outiov_size = 0;
+  tt->outref_start = tt->outref_end = NULL;
+
   tt->tmpbuffer = NULL;
   tt->tmpbuffer_len = 0;
 
+  tt->resbuffer = NULL;
+  tt->resbuffer_len = 0;
+  tt->reserved_out = false;
+
+  tt->outqueue = NULL;
+  tt->outqueue_len = 0;
+  tt->outqueue_size = 0;
+
+  tt->outlimit = 0;
+
+  tt->writer = NULL;
+  tt->writer_size = 0;
+  tt->outdropped = 0;
+  tt->outdropping = false;
+
+  tt->iouring = NULL;
+
+  tt->recorder = NULL;
+
+  tt->frame_depth = 0;
+
+  tt->display_serial = 0;
+  tt->frame_buffer = false;
+
   tt->is_utf8 = TICKIT_MAYBE;
 
   /* Initially; the driver may provide a more accurate value */
   tt->lines = 25;
   tt->cols  = 80;
 
+  tt->cursor_line = tt->cursor_col = -1;
+
   tt->hooks = NULL;
 
   /* Initially empty because we don't necessarily know the initial state
@@ -170,7 +259,6 @@ TickitTerm *tickit_term_new_for_driver(TickitTermDriver *ttd)
 void tickit_term_free(TickitTerm *tt)
 {
   tickit_hooklist_unbind_and_destroy(tt->hooks, tt);
-  tickit_pen_destroy(tt->pen);
 
   if(tt->driver) {
     if(tt->driver->vtable->stop)
@@ -179,15 +267,39 @@ void tickit_term_free(TickitTerm *tt)
     (*tt->driver->vtable->destroy)(tt->driver);
   }
 
+  tickit_pen_destroy(tt->pen);
+
+  if(tt->recorder) {
+    tickit_term_flush(tt);
+    tickit_recorder_destroy(tt->recorder);
+  }
+
+  if(tt->writer)
+    tickit_termwriter_destroy(tt->writer);
+
+  if(tt->iouring) {
+    tickit_term_flush(tt);
+    tickit_iouring_detach(tt->iouring);
+  }
+
   if(tt->termkey)
     termkey_destroy(tt->termkey);
 
   if(tt->outbuffer)
     free(tt->outbuffer);
 
+  if(tt->outiov)
+    free(tt->outiov);
+
+  if(tt->outqueue)
+    free(tt->outqueue);
+
   if(tt->tmpbuffer)
     free(tt->tmpbuffer);
 
+  if(tt->resbuffer)
+    free(tt->resbuffer);
+
   free(tt);
 }
 
@@ -238,6 +350,13 @@ void tickit_term_set_size(TickitTerm *tt, int lines, int cols)
     tt->lines = lines;
     tt->cols  = cols;
 
+    /* The terminal may have clamped or reflowed the cursor and content */
+    tt->cursor_line = tt->cursor_col = -1;
+    tt->display_serial++;
+
+    if(tt->recorder)
+      tickit_recorder_resize(tt->recorder, lines, cols);
+
     TickitEvent args = { .lines = lines, .cols = cols };
     run_events(tt, TICKIT_EV_RESIZE, &args);
   }
@@ -255,10 +374,20 @@ void tickit_term_refresh_size(TickitTerm *tt)
   tickit_term_set_size(tt, ws.ws_row, ws.ws_col);
 }
 
+static bool start_writer(TickitTerm *tt);
+
 void tickit_term_set_output_fd(TickitTerm *tt, int fd)
 {
+  if(tt->writer) {
+    tickit_termwriter_destroy(tt->writer);
+    tt->writer = NULL;
+  }
+
   tt->outfd = fd;
 
+  if(tt->writer_size && fd != -1)
+    start_writer(tt);
+
   tickit_term_refresh_size(tt);
 
   if(tt->state == UNSTARTED) {
@@ -275,8 +404,23 @@ int tickit_term_get_output_fd(const TickitTerm *tt)
 
 void tickit_term_set_output_func(TickitTerm *tt, TickitTermOutputFunc *fn, void *user)
 {
+  /* Only one output function at a time, so output is never split */
   tt->outfunc      = fn;
   tt->outfunc_user = user;
+  tt->outvfunc     = NULL;
+
+  if(tt->state == UNSTARTED) {
+    if(tt->driver->vtable->start)
+      (*tt->driver->vtable->start)(tt->driver);
+    tt->state = STARTING;
+  }
+}
+
+void tickit_term_set_output_vfunc(TickitTerm *tt, TickitTermOutputVFunc *fn, void *user)
+{
+  tt->outvfunc      = fn;
+  tt->outvfunc_user = user;
+  tt->outfunc       = NULL;
 
   if(tt->state == UNSTARTED) {
     if(tt->driver->vtable->start)
@@ -287,6 +431,13 @@ void tickit_term_set_output_func(TickitTerm *tt, TickitTermOutputFunc *fn, void
 
 void tickit_term_set_output_buffer(TickitTerm *tt, size_t len)
 {
+  /* Pending iovecs may point into the old buffer */
+  if(tt->outiov_cnt)
+    tickit_term_flush(tt);
+
+  if(!len && tt->outvectored)
+    len = OUTVECTORED_DEFAULT_BUFFER;
+
   void *buffer = len ? malloc(len) : NULL;
 
   if(tt->outbuffer)
@@ -297,6 +448,57 @@ void tickit_term_set_output_buffer(TickitTerm *tt, size_t len)
   tt->outbuffer_cur = 0;
 }
 
+void tickit_term_begin_frame(TickitTerm *tt)
+{
+  if(tt->frame_depth++)
+    return;
+
+  /* The whole frame must be buffered so it can be written at once */
+  if(!tt->outbuffer) {
+    tickit_term_set_output_buffer(tt, FRAME_DEFAULT_BUFFER);
+    tt->frame_buffer = true;
+  }
+
+  if(tt->driver->vtable->begin_frame)
+    (*tt->driver->vtable->begin_frame)(tt->driver);
+}
+
+void tickit_term_end_frame(TickitTerm *tt)
+{
+  if(!tt->frame_depth || --tt->frame_depth)
+    return;
+
+  if(tt->driver->vtable->end_frame)
+    (*tt->driver->vtable->end_frame)(tt->driver);
+
+  tickit_term_flush(tt);
+  tt->outdropping = false;
+
+  if(tt->frame_buffer) {
+    tickit_term_set_output_buffer(tt, 0);
+    tt->frame_buffer = false;
+  }
+}
+
+void tickit_term_set_output_vectored(TickitTerm *tt, bool vectored)
+{
+  if(!!vectored == tt->outvectored)
+    return;
+
+  tickit_term_flush(tt);
+
+  tt->outvectored = !!vectored;
+
+  /* Short fragments are still copied, so vectored output needs a buffer */
+  if(tt->outvectored && !tt->outbuffer)
+    tickit_term_set_output_buffer(tt, OUTVECTORED_DEFAULT_BUFFER);
+}
+
+bool tickit_term_get_output_vectored(const TickitTerm *tt)
+{
+  return tt->outvectored;
+}
+
 void tickit_term_set_input_fd(TickitTerm *tt, int fd)
 {
   if(tt->termkey)
@@ -353,6 +555,21 @@ void tickit_term_await_started_msec(TickitTerm *tt, long msec)
     tickit_term_await_started_tv(tt, NULL);
 }
 
+/* Moves on to STARTED if the driver has nothing left to wait for */
+static void update_started(TickitTerm *tt)
+{
+  if(tt->state == STARTING &&
+     (!tt->driver->vtable->started ||
+      (*tt->driver->vtable->started)(tt->driver)))
+    tt->state = STARTED;
+}
+
+bool tickit_term_is_started(TickitTerm *tt)
+{
+  update_started(tt);
+  return tt->state == STARTED;
+}
+
 void tickit_term_await_started_tv(TickitTerm *tt, const struct timeval *timeout)
 {
   if(tt->state == STARTED)
@@ -403,8 +620,11 @@ static void got_key(TickitTerm *tt, TermKey *tk, TermKeyKey *key)
   TickitEvent args;
 
   if(tt->driver->vtable->gotkey &&
-     (*tt->driver->vtable->gotkey)(tt->driver, tk, key))
+     (*tt->driver->vtable->gotkey)(tt->driver, tk, key)) {
+    /* That may have been the last reply the driver was waiting for */
+    update_started(tt);
     return;
+  }
 
   if(key->type == TERMKEY_TYPE_MOUSE) {
     TermKeyMouseEvent ev;
@@ -572,42 +792,497 @@ void tickit_term_input_wait_tv(TickitTerm *tt, const struct timeval *timeout)
     tickit_term_input_wait_msec(tt, -1);
 }
 
+static void enqueue_output(TickitTerm *tt, const char *bytes, size_t len)
+{
+  if(tt->outqueue_size < tt->outqueue_len + len) {
+    size_t newsize = tt->outqueue_size ? tt->outqueue_size : 1024;
+    while(newsize < tt->outqueue_len + len)
+      newsize *= 2;
+
+    tt->outqueue = realloc(tt->outqueue, newsize);
+    tt->outqueue_size = newsize;
+  }
+
+  memcpy(tt->outqueue + tt->outqueue_len, bytes, len);
+  tt->outqueue_len += len;
+}
+
+/* Writes as much of the queue as outfd will accept. Returns true if it was
+ * emptied.
+ */
+static bool drain_output(TickitTerm *tt)
+{
+  size_t done = 0;
+
+  while(done < tt->outqueue_len) {
+    ssize_t written = write(tt->outfd, tt->outqueue + done, tt->outqueue_len - done);
+    if(written < 0) {
+      if(errno == EINTR)
+        continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK)
+        break;
+
+      /* Any other error; the output is lost */
+      done = tt->outqueue_len;
+      break;
+    }
+
+    done += written;
+  }
+
+  memmove(tt->outqueue, tt->outqueue + done, tt->outqueue_len - done);
+  tt->outqueue_len -= done;
+
+  return tt->outqueue_len == 0;
+}
+
+/* The terminal no longer shows what we believe it does */
+void tickit_term_forget_state(TickitTerm *tt)
+{
+  tt->cursor_line = tt->cursor_col = -1;
+  /* Make the next setpen send every attribute */
+  tt->pen->valid = 0;
+}
+
+static void output_dropped(TickitTerm *tt, size_t len)
+{
+  tt->outdropped += len;
+  tt->display_serial++;
+
+  /* The rest of the frame would continue from a cursor position and pen the
+   * terminal never reached, so drop that too */
+  if(tt->frame_depth)
+    tt->outdropping = true;
+
+  tickit_term_forget_state(tt);
+}
+
+/* Writes to outfd, queueing anything a non-blocking fd does not accept */
+static void write_fd(TickitTerm *tt, const char *bytes, size_t len)
+{
+  if(tt->iouring) {
+    tickit_iouring_write(tt->iouring, bytes, len);
+    return;
+  }
+
+  if(tt->writer) {
+    if(tt->outdropping || !tickit_termwriter_write(tt->writer, bytes, len))
+      output_dropped(tt, len);
+    return;
+  }
+
+  /* Output must not overtake anything already queued */
+  if(tt->outqueue_len && !drain_output(tt)) {
+    enqueue_output(tt, bytes, len);
+    return;
+  }
+
+  while(len > 0) {
+    ssize_t written = write(tt->outfd, bytes, len);
+    if(written < 0) {
+      if(errno == EINTR)
+        continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK)
+        enqueue_output(tt, bytes, len);
+      return;
+    }
+
+    bytes += written;
+    len   -= written;
+  }
+}
+
+static void writev_fd(TickitTerm *tt, struct iovec *iov, int iovcnt)
+{
+  if(tt->iouring) {
+    for(int i = 0; i < iovcnt; i++)
+      tickit_iouring_write(tt->iouring, iov[i].iov_base, iov[i].iov_len);
+    return;
+  }
+
+  if(tt->writer) {
+    if(tt->outdropping || !tickit_termwriter_writev(tt->writer, iov, iovcnt)) {
+      size_t len = 0;
+      for(int i = 0; i < iovcnt; i++)
+        len += iov[i].iov_len;
+      output_dropped(tt, len);
+    }
+    return;
+  }
+
+  if(tt->outqueue_len && !drain_output(tt)) {
+    for(int i = 0; i < iovcnt; i++)
+      enqueue_output(tt, iov[i].iov_base, iov[i].iov_len);
+    return;
+  }
+
+  while(iovcnt > 0) {
+    ssize_t written = writev(tt->outfd, iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX);
+    if(written < 0) {
+      if(errno == EINTR)
+        continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK)
+        for(int i = 0; i < iovcnt; i++)
+          enqueue_output(tt, iov[i].iov_base, iov[i].iov_len);
+      return;
+    }
+
+    /* Skip past whatever was written, which may end part-way through an iovec */
+    while(iovcnt > 0 && written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++, iovcnt--;
+    }
+    if(iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+}
+
+size_t tickit_term_output_pending(const TickitTerm *tt)
+{
+  size_t pending = tt->outqueue_len;
+  if(tt->writer)
+    pending += tickit_termwriter_pending(tt->writer);
+  if(tt->iouring)
+    pending += tickit_iouring_pending(tt->iouring);
+
+  return pending;
+}
+
+static bool start_writer(TickitTerm *tt)
+{
+  tt->writer = tickit_termwriter_new(tt->outfd, tt->writer_size, tt->writer_policy);
+  if(!tt->writer)
+    return false;
+
+  /* Anything still queued for a non-blocking fd must go first */
+  if(tt->outqueue_len) {
+    if(!tickit_termwriter_write(tt->writer, tt->outqueue, tt->outqueue_len))
+      output_dropped(tt, tt->outqueue_len);
+    tt->outqueue_len = 0;
+  }
+
+  return true;
+}
+
+bool tickit_term_set_output_thread(TickitTerm *tt, size_t bytes, TickitTermWriterPolicy policy)
+{
+  tickit_term_flush(tt);
+
+  if(tt->writer) {
+    tickit_termwriter_destroy(tt->writer);
+    tt->writer = NULL;
+  }
+
+  tt->writer_size   = bytes;
+  tt->writer_policy = policy;
+
+  if(!bytes || tt->outfd == -1)
+    return true;
+
+  if(tt->iouring) {
+    tt->writer_size = 0;
+    return false;
+  }
+
+  if(start_writer(tt))
+    return true;
+
+  tt->writer_size = 0;
+  return false;
+}
+
+bool tickit_term_set_iouring(TickitTerm *tt, TickitIOUring *ring)
+{
+  /* Anything already buffered goes first, by whichever route it was for */
+  tickit_term_flush(tt);
+
+  if(tt->iouring) {
+    tickit_iouring_detach(tt->iouring);
+    tt->iouring = NULL;
+  }
+
+  if(!ring)
+    return true;
+
+  /* Both would write to outfd, in no particular order */
+  if(tt->writer)
+    return false;
+
+  tt->iouring = tickit_iouring_attach(ring, tt, tt->infd, tt->outfd);
+  if(!tt->iouring)
+    return false;
+
+  if(tt->outqueue_len) {
+    tickit_iouring_write(tt->iouring, tt->outqueue, tt->outqueue_len);
+    tt->outqueue_len = 0;
+  }
+
+  return true;
+}
+
+bool tickit_term_start_recording(TickitTerm *tt, int fd, size_t bytes)
+{
+  /* Output from before now isn't part of the recording */
+  tickit_term_flush(tt);
+
+  if(tt->recorder)
+    tickit_recorder_destroy(tt->recorder);
+
+  tt->recorder = tickit_recorder_new(fd, bytes, tt->lines, tt->cols, tt->termtype);
+
+  return tt->recorder != NULL;
+}
+
+void tickit_term_stop_recording(TickitTerm *tt)
+{
+  if(!tt->recorder)
+    return;
+
+  tickit_term_flush(tt);
+
+  tickit_recorder_destroy(tt->recorder);
+  tt->recorder = NULL;
+}
+
+size_t tickit_term_output_dropped(TickitTerm *tt)
+{
+  size_t dropped = tt->outdropped;
+  tt->outdropped = 0;
+  return dropped;
+}
+
+void tickit_term_output_writable(TickitTerm *tt)
+{
+  if(tt->outqueue_len && tt->outfd != -1)
+    drain_output(tt);
+}
+
+void tickit_term_set_output_limit(TickitTerm *tt, size_t bytes)
+{
+  tt->outlimit = bytes;
+}
+
+size_t tickit_term_get_output_limit(const TickitTerm *tt)
+{
+  return tt->outlimit;
+}
+
+bool tickit_term_is_congested(TickitTerm *tt)
+{
+  if(!tt->outlimit)
+    return false;
+
+  size_t outstanding = tickit_term_output_pending(tt);
+
+#ifdef TIOCOUTQ
+  /* Bytes written but not yet sent by the tty or socket */
+  int queued;
+  if(tt->outfd != -1 && ioctl(tt->outfd, TIOCOUTQ, &queued) == 0 && queued > 0)
+    outstanding += queued;
+#endif
+
+  return outstanding > tt->outlimit;
+}
+
+static void flush_vectored(TickitTerm *tt)
+{
+  if(tt->recorder)
+    tickit_recorder_output(tt->recorder, tt->outiov, tt->outiov_cnt);
+
+  if(tt->outvfunc)
+    (*tt->outvfunc)(tt, tt->outiov, tt->outiov_cnt, tt->outvfunc_user);
+  else if(tt->outfunc) {
+    for(int i = 0; i < tt->outiov_cnt; i++)
+      (*tt->outfunc)(tt, tt->outiov[i].iov_base, tt->outiov[i].iov_len, tt->outfunc_user);
+  }
+  else if(tt->outfd != -1) {
+    writev_fd(tt, tt->outiov, tt->outiov_cnt);
+  }
+
+  tt->outiov_cnt = 0;
+  tt->outbuffer_cur = 0;
+}
+
 void tickit_term_flush(TickitTerm *tt)
 {
+  if(tt->outiov_cnt) {
+    flush_vectored(tt);
+    return;
+  }
+
   if(tt->outbuffer_cur == 0)
     return;
 
+  if(tt->recorder)
+    tickit_recorder_output(tt->recorder, &(struct iovec){ tt->outbuffer, tt->outbuffer_cur }, 1);
+
   if(tt->outfunc)
     (*tt->outfunc)(tt, tt->outbuffer, tt->outbuffer_cur, tt->outfunc_user);
+  else if(tt->outvfunc)
+    (*tt->outvfunc)(tt, &(struct iovec){ tt->outbuffer, tt->outbuffer_cur }, 1, tt->outvfunc_user);
   else if(tt->outfd != -1) {
-    write(tt->outfd, tt->outbuffer, tt->outbuffer_cur);
+    write_fd(tt, tt->outbuffer, tt->outbuffer_cur);
   }
 
   tt->outbuffer_cur = 0;
 }
 
+/* Within a frame the buffer is grown rather than flushed when it fills */
+static void grow_outbuffer(TickitTerm *tt, size_t len)
+{
+  size_t newlen = tt->outbuffer_len;
+  while(newlen < tt->outbuffer_cur + len)
+    newlen *= 2;
+
+  char *old = tt->outbuffer;
+  tt->outbuffer = malloc(newlen);
+  memcpy(tt->outbuffer, old, tt->outbuffer_cur);
+
+  /* Pending iovecs may point into the old buffer */
+  for(int i = 0; i < tt->outiov_cnt; i++) {
+    char *base = tt->outiov[i].iov_base;
+    if(base >= old && base < old + tt->outbuffer_cur)
+      tt->outiov[i].iov_base = tt->outbuffer + (base - old);
+  }
+
+  free(old);
+  tt->outbuffer_len = newlen;
+}
+
+static void write_iov(TickitTerm *tt, const char *str, size_t len)
+{
+  if(tt->outiov_cnt == tt->outiov_size) {
+    if(tt->outiov_size && !tt->frame_depth)
+      flush_vectored(tt);
+    else {
+      tt->outiov_size = tt->outiov_size ? tt->outiov_size * 2 : OUTIOV_INITIAL;
+      tt->outiov = realloc(tt->outiov, tt->outiov_size * sizeof(struct iovec));
+    }
+  }
+
+  tt->outiov[tt->outiov_cnt].iov_base = (void *)str;
+  tt->outiov[tt->outiov_cnt].iov_len  = len;
+  tt->outiov_cnt++;
+}
+
+/* Adds bytes just placed at dest in outbuffer to the iovecs, coalescing with
+ * the previous one if it ends where these start */
+static void write_iov_outbuffer(TickitTerm *tt, char *dest, size_t len)
+{
+  struct iovec *last = tt->outiov_cnt ? &tt->outiov[tt->outiov_cnt - 1] : NULL;
+  if(last && (char *)last->iov_base + last->iov_len == dest)
+    last->iov_len += len;
+  else
+    write_iov(tt, dest, len);
+}
+
+void tickit_term_release_refs(TickitTerm *tt)
+{
+  if(!tt->frame_depth) {
+    tickit_term_flush(tt);
+    return;
+  }
+
+  /* Flushing now would split the frame, so copy the referenced text to the
+   * end of the buffer instead, leaving the iovecs in order */
+  size_t need = 0;
+  for(int i = 0; i < tt->outiov_cnt; i++) {
+    char *base = tt->outiov[i].iov_base;
+    if(base < tt->outbuffer || base >= tt->outbuffer + tt->outbuffer_len)
+      need += tt->outiov[i].iov_len;
+  }
+
+  if(!need)
+    return;
+
+  if(need > tt->outbuffer_len - tt->outbuffer_cur)
+    grow_outbuffer(tt, need);
+
+  for(int i = 0; i < tt->outiov_cnt; i++) {
+    char *base = tt->outiov[i].iov_base;
+    if(base >= tt->outbuffer && base < tt->outbuffer + tt->outbuffer_len)
+      continue;
+
+    char *dest = tt->outbuffer + tt->outbuffer_cur;
+    memcpy(dest, base, tt->outiov[i].iov_len);
+    tt->outiov[i].iov_base = dest;
+    tt->outbuffer_cur += tt->outiov[i].iov_len;
+  }
+}
+
+static void write_str_vectored(TickitTerm *tt, const char *str, size_t len)
+{
+  if(len >= OUTREF_MIN &&
+     str >= tt->outref_start && str + len <= tt->outref_end) {
+    write_iov(tt, str, len);
+    return;
+  }
+
+  if(tt->frame_depth && len > tt->outbuffer_len - tt->outbuffer_cur)
+    grow_outbuffer(tt, len);
+
+  while(len > 0) {
+    size_t space = tt->outbuffer_len - tt->outbuffer_cur;
+    if(!space) {
+      flush_vectored(tt);
+      continue;
+    }
+    if(len < space)
+      space = len;
+
+    char *dest = tt->outbuffer + tt->outbuffer_cur;
+    memcpy(dest, str, space);
+    tt->outbuffer_cur += space;
+
+    write_iov_outbuffer(tt, dest, space);
+
+    str += space;
+    len -= space;
+  }
+}
+
 static void write_str(TickitTerm *tt, const char *str, size_t len)
 {
   if(len == 0)
     len = strlen(str);
 
+  if(tt->outvectored) {
+    write_str_vectored(tt, str, len);
+    return;
+  }
+
   if(tt->outbuffer) {
+    if(tt->frame_depth && len > tt->outbuffer_len - tt->outbuffer_cur)
+      grow_outbuffer(tt, len);
+
     while(len > 0) {
       size_t space = tt->outbuffer_len - tt->outbuffer_cur;
       if(len < space)
         space = len;
       memcpy(tt->outbuffer + tt->outbuffer_cur, str, space);
       tt->outbuffer_cur += space;
+      str += space;
       len -= space;
-      if(tt->outbuffer_cur >= tt->outbuffer_len)
+      if(tt->outbuffer_cur >= tt->outbuffer_len && !tt->frame_depth)
         tickit_term_flush(tt);
     }
+    return;
   }
-  else if(tt->outfunc) {
+
+  /* Unbuffered, so this is what would otherwise have been flushed */
+  if(tt->recorder)
+    tickit_recorder_output(tt->recorder, &(struct iovec){ (void *)str, len }, 1);
+
+  if(tt->outfunc) {
     (*tt->outfunc)(tt, str, len, tt->outfunc_user);
   }
+  else if(tt->outvfunc) {
+    (*tt->outvfunc)(tt, &(struct iovec){ (void *)str, len }, 1, tt->outvfunc_user);
+  }
   else if(tt->outfd != -1) {
-    write(tt->outfd, str, len);
+    write_fd(tt, str, len);
   }
 }
 /* Driver API */
@@ -616,21 +1291,88 @@ void tickit_termdrv_write_str(TickitTermDriver *ttd, const char *str, size_t len
   write_str(ttd->tt, str, len);
 }
 
-static void write_vstrf(TickitTerm *tt, const char *fmt, va_list args)
+/* Returns space for at least len bytes of output to be formatted into, and
+ * sets *avail to how much there actually is. Where possible this is the
+ * free end of outbuffer, so that commit_output() need not copy it.
+ */
+static char *reserve_output(TickitTerm *tt, size_t len, size_t *avail)
+{
+  if(tt->outbuffer) {
+    if(len > tt->outbuffer_len - tt->outbuffer_cur) {
+      if(tt->frame_depth)
+        grow_outbuffer(tt, len);
+      else
+        tickit_term_flush(tt);
+    }
+
+    if(len <= tt->outbuffer_len - tt->outbuffer_cur) {
+      tt->reserved_out = true;
+      *avail = tt->outbuffer_len - tt->outbuffer_cur;
+      return tt->outbuffer + tt->outbuffer_cur;
+    }
+  }
+
+  tt->reserved_out = false;
+  if(tt->resbuffer_len < len) {
+    free(tt->resbuffer);
+    tt->resbuffer = malloc(len);
+    tt->resbuffer_len = len;
+  }
+  *avail = tt->resbuffer_len;
+  return tt->resbuffer;
+}
+
+static void commit_output(TickitTerm *tt, size_t len)
 {
-  /* It's likely the output will fit in, say, 64 bytes */
-  char buffer[64];
-  size_t len = vsnprintf(buffer, sizeof buffer, fmt, args);
+  if(!len)
+    return;
 
-  if(len < 64) {
-    write_str(tt, buffer, len);
+  if(!tt->reserved_out) {
+    write_str(tt, tt->resbuffer, len);
     return;
   }
 
-  char *morebuffer = get_tmpbuffer(tt, len + 1);
-  vsnprintf(morebuffer, len + 1, fmt, args);
+  char *dest = tt->outbuffer + tt->outbuffer_cur;
+  tt->outbuffer_cur += len;
 
-  write_str(tt, morebuffer, len);
+  if(tt->outvectored)
+    write_iov_outbuffer(tt, dest, len);
+  else if(tt->outbuffer_cur >= tt->outbuffer_len && !tt->frame_depth)
+    tickit_term_flush(tt);
+}
+
+/* Driver API */
+char *tickit_termdrv_reserve(TickitTermDriver *ttd, size_t len)
+{
+  size_t avail;
+  return reserve_output(ttd->tt, len, &avail);
+}
+
+/* Driver API */
+void tickit_termdrv_commit(TickitTermDriver *ttd, size_t len)
+{
+  commit_output(ttd->tt, len);
+}
+
+static void write_vstrf(TickitTerm *tt, const char *fmt, va_list args)
+{
+  va_list args2;
+  va_copy(args2, args);
+
+  /* It's likely the output will fit in, say, 64 bytes, or whatever is left
+   * of the output buffer, so only rarely is a second pass needed */
+  size_t avail;
+  char *buf = reserve_output(tt, 64, &avail);
+  size_t len = vsnprintf(buf, avail, fmt, args);
+
+  if(len >= avail) {
+    buf = reserve_output(tt, len + 1, &avail);
+    vsnprintf(buf, avail, fmt, args2);
+  }
+
+  commit_output(tt, len);
+
+  va_end(args2);
 }
 
 /* Driver API */
@@ -642,14 +1384,142 @@ void tickit_termdrv_write_strf(TickitTermDriver *ttd, const char *fmt, ...)
   va_end(args);
 }
 
+/* Longest CSI we will format; a leader, CSI_MAX_PARAMS of up to 10 digits
+ * each plus separators, and a few intermediate and final bytes
+ */
+#define CSI_MAX_PARAMS 16
+#define CSI_MAX        (2 + 1 + CSI_MAX_PARAMS * 11 + 8)
+
+static size_t format_csi(char *buffer, const char *cmd, int nparams, va_list args)
+{
+  char *s = buffer;
+
+  *s++ = '\e';
+  *s++ = '[';
+  if(*cmd >= 0x3c && *cmd <= 0x3f)
+    *s++ = *cmd++;
+
+  for(int i = 0; i < nparams; i++) {
+    int val = va_arg(args, int);
+    if(i)
+      *s++ = ';';
+    if(val >= 0)
+      s = termdrv_put_uint(s, val);
+  }
+
+  while(*cmd && s < buffer + CSI_MAX)
+    *s++ = *cmd++;
+
+  return s - buffer;
+}
+
+/* Driver API */
+void tickit_termdrv_write_csi(TickitTermDriver *ttd, const char *cmd, int nparams, ...)
+{
+  TickitTerm *tt = ttd->tt;
+  va_list args;
+
+  if(nparams > CSI_MAX_PARAMS)
+    nparams = CSI_MAX_PARAMS;
+
+  va_start(args, nparams);
+
+  size_t avail;
+  char *buf = reserve_output(tt, CSI_MAX, &avail);
+  commit_output(tt, format_csi(buf, cmd, nparams, args));
+
+  va_end(args);
+}
+
+/* Advances the tracked cursor over printed text. Anything we can't measure,
+ * such as control characters, makes the position unknown, as does reaching
+ * the right-hand edge because of the terminal's pending-wrap state
+ */
+static void advance_cursor(TickitTerm *tt, const char *str, size_t len)
+{
+  if(tt->cursor_col == -1)
+    return;
+
+  size_t i;
+  for(i = 0; i < len; i++)
+    if(str[i] < 0x20 || str[i] >= 0x7f)
+      break;
+
+  int cols = i;
+  if(i < len) {
+    TickitStringPos pos, limit;
+    tickit_stringpos_zero(&pos);
+    tickit_stringpos_limit_bytes(&limit, len - i);
+
+    if(tickit_string_ncount(str + i, len - i, &pos, &limit) == (size_t)-1) {
+      tt->cursor_line = tt->cursor_col = -1;
+      return;
+    }
+    cols += pos.columns;
+  }
+
+  tt->cursor_col += cols;
+  if(tt->cursor_col >= tt->cols)
+    tt->cursor_line = tt->cursor_col = -1;
+}
+
 void tickit_term_print(TickitTerm *tt, const char *str)
 {
-  (*tt->driver->vtable->print)(tt->driver, str, strlen(str));
+  size_t len = strlen(str);
+  (*tt->driver->vtable->print)(tt->driver, str, len);
+  advance_cursor(tt, str, len);
 }
 
 void tickit_term_printn(TickitTerm *tt, const char *str, size_t len)
 {
   (*tt->driver->vtable->print)(tt->driver, str, len);
+  advance_cursor(tt, str, len);
+}
+
+void tickit_term_printn_ref(TickitTerm *tt, const char *str, size_t len)
+{
+  tt->outref_start = str;
+  tt->outref_end   = str + len;
+
+  (*tt->driver->vtable->print)(tt->driver, str, len);
+  advance_cursor(tt, str, len);
+
+  tt->outref_start = tt->outref_end = NULL;
+}
+
+void tickit_term_printrep(TickitTerm *tt, const char *str, size_t len, int count)
+{
+  if(count < 1)
+    return;
+
+  if(count == 1 || !tt->driver->vtable->printrep ||
+     !(*tt->driver->vtable->printrep)(tt->driver, str, len, count)) {
+    char *buf = get_tmpbuffer(tt, len * count);
+    for(int i = 0; i < count; i++)
+      memcpy(buf + i * len, str, len);
+
+    (*tt->driver->vtable->print)(tt->driver, buf, len * count);
+  }
+
+  if(tt->cursor_col != -1) {
+    int col = tt->cursor_col;
+    advance_cursor(tt, str, len);
+    if(tt->cursor_col != -1)
+      tt->cursor_col = col + (tt->cursor_col - col) * count;
+    if(tt->cursor_col >= tt->cols)
+      tt->cursor_line = tt->cursor_col = -1;
+  }
+}
+
+bool tickit_term_print_acs(TickitTerm *tt, const char *acs, size_t len)
+{
+  if(!tt->driver->vtable->print_acs ||
+     !(*tt->driver->vtable->print_acs)(tt->driver, acs, len))
+    return false;
+
+  /* Each ACS character is a single-column glyph, so this counts the same */
+  advance_cursor(tt, acs, len);
+  return true;
 }
 
 void tickit_term_printf(TickitTerm *tt, const char *fmt, ...)
@@ -665,22 +1535,59 @@ void tickit_term_vprintf(TickitTerm *tt, const char *fmt, va_list args)
   va_list args2;
   va_copy(args2, args);
 
-  size_t len = vsnprintf(NULL, 0, fmt, args);
-  char *buf = get_tmpbuffer(tt, len + 1);
-  vsnprintf(buf, len + 1, fmt, args2);
+  /* Format into however large the temporary buffer already is, so that
+   * usually one pass is enough */
+  char *buf = get_tmpbuffer(tt, 64);
+  size_t len = vsnprintf(buf, tt->tmpbuffer_len, fmt, args);
+  if(len >= tt->tmpbuffer_len) {
+    buf = get_tmpbuffer(tt, len + 1);
+    vsnprintf(buf, len + 1, fmt, args2);
+  }
+
   (*tt->driver->vtable->print)(tt->driver, buf, len);
+  advance_cursor(tt, buf, len);
 
   va_end(args2);
 }
 
 bool tickit_term_goto(TickitTerm *tt, int line, int col)
 {
-  return (*tt->driver->vtable->goto_abs)(tt->driver, line, col);
+  if((line == -1 || line == tt->cursor_line) &&
+     (col == -1 || col == tt->cursor_col))
+    return true;
+
+  if(!(*tt->driver->vtable->goto_abs)(tt->driver, line, col)) {
+    tt->cursor_line = tt->cursor_col = -1;
+    return false;
+  }
+
+  if(line != -1)
+    tt->cursor_line = line;
+  if(col != -1)
+    tt->cursor_col = col;
+
+  return true;
 }
 
 void tickit_term_move(TickitTerm *tt, int downward, int rightward)
 {
   (*tt->driver->vtable->move_rel)(tt->driver, downward, rightward);
+
+  /* The terminal stops the cursor at the edges of the screen */
+  if(tt->cursor_line != -1) {
+    tt->cursor_line += downward;
+    if(tt->cursor_line < 0)
+      tt->cursor_line = 0;
+    if(tt->cursor_line > tt->lines - 1)
+      tt->cursor_line = tt->lines - 1;
+  }
+  if(tt->cursor_col != -1) {
+    tt->cursor_col += rightward;
+    if(tt->cursor_col < 0)
+      tt->cursor_col = 0;
+    if(tt->cursor_col > tt->cols - 1)
+      tt->cursor_col = tt->cols - 1;
+  }
 }
 
 bool tickit_term_scrollrect(TickitTerm *tt, int top, int left, int lines, int cols, int downward, int rightward)
@@ -691,6 +1598,10 @@ bool tickit_term_scrollrect(TickitTerm *tt, int top, int left, int lines, int co
     .lines = lines,
     .cols  = cols,
   };
+
+  /* Drivers move the cursor around to perform the scroll */
+  tt->cursor_line = tt->cursor_col = -1;
+
   return (*tt->driver->vtable->scrollrect)(tt->driver, &rect, downward, rightward);
 }
 
@@ -702,59 +1613,43 @@ static int convert_colour(int index, int colours)
     return xterm256[index].as8;
 }
 
-void tickit_term_chpen(TickitTerm *tt, const TickitPen *pen)
+/* Moves the terminal towards the target pen, by computing the delta against
+ * the current pen and passing that to the driver. The pens live on the stack,
+ * so this never allocates
+ */
+static void change_pen(TickitTerm *tt, TickitPen *target)
 {
-  TickitPen *delta = tickit_pen_new();
+  if(target->valid & PEN_ATTR_BIT(TICKIT_PEN_FG) && target->fg >= tt->colors)
+    target->fg = convert_colour(target->fg, tt->colors);
+  if(target->valid & PEN_ATTR_BIT(TICKIT_PEN_BG) && target->bg >= tt->colors)
+    target->bg = convert_colour(target->bg, tt->colors);
 
-  for(TickitPenAttr attr = 0; attr < TICKIT_N_PEN_ATTRS; attr++) {
-    if(!tickit_pen_has_attr(pen, attr))
-      continue;
+  unsigned int changed = pen_diff_mask(tt->pen, target);
 
-    if(tickit_pen_has_attr(tt->pen, attr) && tickit_pen_equiv_attr(tt->pen, pen, attr))
-      continue;
+  TickitPen delta;
+  pen_init_empty(&delta);
+  pen_copy_masked(&delta, target, changed);
 
-    int index;
-    if((attr == TICKIT_PEN_FG || attr == TICKIT_PEN_BG) &&
-       (index = tickit_pen_get_colour_attr(pen, attr)) >= tt->colors) {
-      index = convert_colour(index, tt->colors);
-      tickit_pen_set_colour_attr(tt->pen, attr, index);
-      tickit_pen_set_colour_attr(delta, attr, index);
-    }
-    else {
-      tickit_pen_copy_attr(tt->pen, pen, attr);
-      tickit_pen_copy_attr(delta, pen, attr);
-    }
-  }
-
-  (*tt->driver->vtable->chpen)(tt->driver, delta, tt->pen);
+  pen_copy_masked(tt->pen, target, changed);
 
-  tickit_pen_destroy(delta);
+  (*tt->driver->vtable->chpen)(tt->driver, &delta, tt->pen);
 }
 
-void tickit_term_setpen(TickitTerm *tt, const TickitPen *pen)
+void tickit_term_chpen(TickitTerm *tt, const TickitPen *pen)
 {
-  TickitPen *delta = tickit_pen_new();
-
-  for(TickitPenAttr attr = 0; attr < TICKIT_N_PEN_ATTRS; attr++) {
-    if(tickit_pen_has_attr(tt->pen, attr) && tickit_pen_equiv_attr(tt->pen, pen, attr))
-      continue;
+  TickitPen target = *pen;
+  target.hooks = NULL;
 
-    int index;
-    if((attr == TICKIT_PEN_FG || attr == TICKIT_PEN_BG) &&
-       (index = tickit_pen_get_colour_attr(pen, attr)) >= tt->colors) {
-      index = convert_colour(index, tt->colors);
-      tickit_pen_set_colour_attr(tt->pen, attr, index);
-      tickit_pen_set_colour_attr(delta, attr, index);
-    }
-    else {
-      tickit_pen_copy_attr(tt->pen, pen, attr);
-      tickit_pen_copy_attr(delta, pen, attr);
-    }
-  }
+  change_pen(tt, &target);
+}
 
-  (*tt->driver->vtable->chpen)(tt->driver, delta, tt->pen);
+void tickit_term_setpen(TickitTerm *tt, const TickitPen *pen)
+{
+  TickitPen target = *pen;
+  target.hooks = NULL;
+  pen_fill_defaults(&target);
 
-  tickit_pen_destroy(delta);
+  change_pen(tt, &target);
 }
 
 /* Driver API */
@@ -763,14 +1658,76 @@ TickitPen *tickit_termdrv_current_pen(TickitTermDriver *ttd)
   return ttd->tt->pen;
 }
 
+/* Driver API */
+bool tickit_termdrv_get_cursor(TickitTermDriver *ttd, int *line, int *col)
+{
+  TickitTerm *tt = ttd->tt;
+  if(tt->cursor_line == -1 || tt->cursor_col == -1)
+    return false;
+
+  *line = tt->cursor_line;
+  *col  = tt->cursor_col;
+  return true;
+}
+
+void tickit_termdrv_caps_changed(TickitTermDriver *ttd)
+{
+  /* Whatever was drawn using the old capabilities may need drawing again */
+  ttd->tt->display_serial++;
+
+  TickitEvent args = { 0 };
+  run_events(ttd->tt, TICKIT_EV_CAPS, &args);
+}
+
 void tickit_term_clear(TickitTerm *tt)
 {
   (*tt->driver->vtable->clear)(tt->driver);
+
+  /* Some terminals home the cursor on clear and some don't */
+  tt->cursor_line = tt->cursor_col = -1;
+  tt->display_serial++;
+}
+
+unsigned int tickit_term_display_serial(const TickitTerm *tt)
+{
+  return tt->display_serial;
 }
 
 void tickit_term_erasech(TickitTerm *tt, int count, TickitMaybeBool moveend)
 {
   (*tt->driver->vtable->erasech)(tt->driver, count, moveend);
+
+  if(count < 1 || tt->cursor_col == -1)
+    return;
+
+  if(moveend == TICKIT_YES)
+    tt->cursor_col += count;
+  else if(moveend != TICKIT_NO)
+    tt->cursor_col = -1;
+
+  if(tt->cursor_col >= tt->cols)
+    tt->cursor_line = tt->cursor_col = -1;
+}
+
+bool tickit_term_erase_below(TickitTerm *tt)
+{
+  if(tt->driver->vtable->erase_below &&
+     (*tt->driver->vtable->erase_below)(tt->driver))
+    return true;
+
+  /* Otherwise erase line by line, which needs to know where we start */
+  if(tt->cursor_line == -1 || tt->cursor_col == -1)
+    return false;
+
+  int line = tt->cursor_line;
+  tickit_term_erasech(tt, tt->cols - tt->cursor_col, TICKIT_MAYBE);
+
+  for(line++; line < tt->lines; line++) {
+    tickit_term_goto(tt, line, 0);
+    tickit_term_erasech(tt, tt->cols, TICKIT_MAYBE);
+  }
+
+  return true;
 }
 
 bool tickit_term_getctl_int(TickitTerm *tt, TickitTermCtl ctl, int *value)
@@ -780,6 +1737,13 @@ bool tickit_term_getctl_int(TickitTerm *tt, TickitTermCtl ctl, int *value)
 
 bool tickit_term_setctl_int(TickitTerm *tt, TickitTermCtl ctl, int value)
 {
+  /* Switching screen buffers may save or restore the cursor, and shows
+   * different content */
+  if(ctl == TICKIT_TERMCTL_ALTSCREEN) {
+    tt->cursor_line = tt->cursor_col = -1;
+    tt->display_serial++;
+  }
+
   return (*tt->driver->vtable->setctl_int)(tt->driver, ctl, value);
 }
 
@@ -0,0 +1,21 @@
+#include "tickit.h"
+
+/* Private TickitTerm functions for other parts of the library */
+
+/* Forgets the cursor position and pen the terminal is believed to have, so
+ * that the next goto and setpen send them in full. For when bytes have been
+ * written to the terminal other than by this instance
+ */
+void tickit_term_forget_state(TickitTerm *tt);
+
+/* Ensures vectored output no longer refers to text given to
+ * tickit_term_printn_ref(), so the caller may free it. Outside a frame this
+ * flushes; within one the text is copied into the output buffer instead
+ */
+void tickit_term_release_refs(TickitTerm *tt);
+
+/* Returns a number that changes whenever the screen may no longer show what
+ * was drawn on it: after a clear, a switch of screen buffer, a resize, dropped
+ * output or a change of capabilities
+ */
+unsigned int tickit_term_display_serial(const TickitTerm *tt);
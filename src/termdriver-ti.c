@@ -1,9 +1,13 @@
+/* We need strdup() and pthreads */
+#define _POSIX_C_SOURCE 200809L
+
 #include "termdriver.h"
 
 // This entire driver requires unibilium
 #ifdef HAVE_UNIBILIUM
 #include "unibilium.h"
 
+#include <pthread.h>
 #include <string.h>
 #include <stdarg.h>
 
@@ -71,52 +75,313 @@ static const char *require_ti_string(unibi_term *ut, const char *termtype, enum
   abort();
 }
 
+/* A TI string compiled when the driver is created, into chunks of literal
+ * text with an integer parameter printed in decimal between each. This covers
+ * the %p1%d forms used by most positioning and editing strings, plus %i and
+ * %%, so those can be expanded without running unibilium's interpreter every
+ * time. Anything else, such as conditionals, arithmetic or padding, leaves
+ * the string to unibi_run()
+ */
+#define TI_MAX_PARAMS 4
+
+typedef struct {
+  const char *str;
+  int n_params; // -1 if not compiled
+  bool incr;    // %i; the first two parameters count from 1
+  signed char param[TI_MAX_PARAMS]; // which argument each parameter is
+  size_t litlen[TI_MAX_PARAMS + 1]; // the chunks around them
+  size_t totallen;
+  char lit[];
+} TIString;
+
+static TIString *compile_ti(const char *str)
+{
+  if(!str)
+    return NULL;
+
+  TIString *ts = malloc(sizeof(TIString) + strlen(str));
+  ts->str      = str;
+  ts->n_params = 0;
+  ts->incr     = false;
+  ts->totallen = 0;
+  memset(ts->litlen, 0, sizeof(ts->litlen));
+
+  int pushed = -1;
+
+  for(const char *s = str; *s; s++) {
+    if(*s == '$' && s[1] == '<')
+      goto interpreted;
+
+    if(*s != '%') {
+      ts->lit[ts->totallen++] = *s;
+      ts->litlen[ts->n_params]++;
+      continue;
+    }
+
+    switch(*++s) {
+      case '%':
+        ts->lit[ts->totallen++] = '%';
+        ts->litlen[ts->n_params]++;
+        break;
+
+      case 'i':
+        if(ts->n_params || pushed != -1)
+          goto interpreted;
+        ts->incr = true;
+        break;
+
+      case 'p':
+        if(s[1] < '1' || s[1] > '9' || pushed != -1)
+          goto interpreted;
+        pushed = *++s - '1';
+        break;
+
+      case 'd':
+        if(pushed == -1 || ts->n_params == TI_MAX_PARAMS)
+          goto interpreted;
+        ts->param[ts->n_params++] = pushed;
+        pushed = -1;
+        break;
+
+      default:
+        goto interpreted;
+    }
+  }
+
+  if(pushed == -1)
+    return ts;
+
+interpreted:
+  ts->n_params = -1;
+  return ts;
+}
+
+/* Writes a decimal integer at s, as %d would */
+static char *put_int(char *s, int val)
+{
+  if(val < 0) {
+    *s++ = '-';
+    return termdrv_put_uint(s, -(unsigned int)val);
+  }
+
+  return termdrv_put_uint(s, val);
+}
+
+static int int_len(int val)
+{
+  return val < 0 ? 1 + termdrv_uint_len(-(unsigned int)val) : termdrv_uint_len(val);
+}
+
+/* Capabilities and strings derived from one terminfo entry */
+struct TICap {
+  unsigned int bce:1;
+  int colours;
+  const char *acsc; // ACS character pairs
+};
+
+struct TIStr {
+  // Positioning
+  TIString *cup;    // cursor_address
+  TIString *vpa;    // row_address == vertical position absolute
+  TIString *hpa;    // column_address = horizontal position absolute
+
+  // Moving
+  TIString *cr;                      // Carriage Return
+  TIString *cuu; TIString *cuu1;     // Cursor Up
+  TIString *cud; TIString *cud1;     // Cursor Down
+  TIString *cuf; TIString *cuf1;     // Cursor Forward == Right
+  TIString *cub; TIString *cub1;     // Cursor Backward == Left
+
+  // Editing
+  TIString *ich; TIString *ich1;     // Insert Character
+  TIString *dch; TIString *dch1;     // Delete Character
+  TIString *il;  TIString *il1;      // Insert Line
+  TIString *dl;  TIString *dl1;      // Delete Line
+  TIString *ech;                     // Erase Character
+  TIString *el;                      // Erase in Line (to end)
+  TIString *ed;                      // Erase in Display (to end)
+  TIString *rep;                     // Repeat Character
+  TIString *smacs; TIString *rmacs; // Enter/exit alternate character set
+  TIString *enacs;                   // Enable alternate character set
+  TIString *ed2;                     // Erase Data 2 == Clear screen
+  TIString *stbm;                    // Set Top/Bottom Margins
+
+  // Formatting
+  TIString *sgr;      // Select Graphic Rendition
+  TIString *sgr_fg;   // SGR foreground colour
+  TIString *sgr_bg;   // SGR background colour
+
+  // Mode setting/clearing
+  TIString *sm_csr; TIString *rm_csr; // Set/reset mode: Cursor visible
+};
+
+/* Parsing a terminfo entry means reading it from disk, so the parsed entry
+ * and the strings compiled from it are shared between every driver for the
+ * same termtype, in a process-wide cache. Entries are kept for a while after
+ * their last driver goes, so that a program creating and destroying
+ * terminals over and over does not keep rereading the same few files.
+ */
+struct TIEntry {
+  struct TIEntry *next;
+  char *termtype;
+  int refcount;
+
+  unibi_term *ut;
+
+  struct TICap cap;
+  struct TIStr str;
+  const struct TermInfoExtraStrings *extra;
+};
+
+/* How many entries no driver is using to keep around */
+#define TI_CACHE_IDLE_MAX 8
+
+static pthread_mutex_t ti_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct TIEntry *ti_cache; // most recently used first
+
+static void free_entry(struct TIEntry *e)
+{
+  /* str is nothing but TIString pointers */
+  TIString **strs = (TIString **)&e->str;
+  for(size_t i = 0; i < sizeof(e->str) / sizeof(TIString *); i++)
+    free(strs[i]);
+
+  unibi_destroy(e->ut);
+  free(e->termtype);
+  free(e);
+}
+
+static struct TIEntry *new_entry(const char *termtype)
+{
+  unibi_term *ut = unibi_from_term(termtype);
+  if(!ut)
+    return NULL;
+
+  struct TIEntry *e = malloc(sizeof(struct TIEntry));
+  e->termtype = strdup(termtype);
+  e->refcount = 0;
+  e->ut = ut;
+
+  e->cap.bce = unibi_get_bool(ut, unibi_back_color_erase);
+  e->cap.colours = unibi_get_num(ut, unibi_max_colors);
+
+  e->str.cup    = compile_ti(require_ti_string(ut, termtype, unibi_cursor_address, "cup"));
+  e->str.vpa    = compile_ti(lookup_ti_string (ut, termtype, unibi_row_address));
+  e->str.hpa    = compile_ti(lookup_ti_string (ut, termtype, unibi_column_address));
+  e->str.cr     = compile_ti(lookup_ti_string (ut, termtype, unibi_carriage_return));
+  e->str.cuu    = compile_ti(require_ti_string(ut, termtype, unibi_parm_up_cursor, "cuu"));
+  e->str.cuu1   = compile_ti(lookup_ti_string (ut, termtype, unibi_cursor_up));
+  e->str.cud    = compile_ti(require_ti_string(ut, termtype, unibi_parm_down_cursor, "cud"));
+  /* As curses does, ignore a cud1 that is a bare linefeed; the tty's ONLCR
+   * would turn it into CR+LF and move the cursor to column 0 */
+  const char *cud1 = lookup_ti_string(ut, termtype, unibi_cursor_down);
+  if(cud1 && strcmp(cud1, "\n") == 0)
+    cud1 = NULL;
+  e->str.cud1   = compile_ti(cud1);
+  e->str.cuf    = compile_ti(require_ti_string(ut, termtype, unibi_parm_right_cursor, "cuf"));
+  e->str.cuf1   = compile_ti(lookup_ti_string (ut, termtype, unibi_cursor_right));
+  e->str.cub    = compile_ti(require_ti_string(ut, termtype, unibi_parm_left_cursor, "cub"));
+  e->str.cub1   = compile_ti(lookup_ti_string (ut, termtype, unibi_cursor_left));
+  e->str.ich    = compile_ti(require_ti_string(ut, termtype, unibi_parm_ich, "ich"));
+  e->str.ich1   = compile_ti(lookup_ti_string (ut, termtype, unibi_insert_character));
+  e->str.dch    = compile_ti(require_ti_string(ut, termtype, unibi_parm_dch, "dch"));
+  e->str.dch1   = compile_ti(lookup_ti_string (ut, termtype, unibi_delete_character));
+  e->str.il     = compile_ti(require_ti_string(ut, termtype, unibi_parm_insert_line, "il"));
+  e->str.il1    = compile_ti(lookup_ti_string (ut, termtype, unibi_insert_line));
+  e->str.dl     = compile_ti(require_ti_string(ut, termtype, unibi_parm_delete_line, "dl"));
+  e->str.dl1    = compile_ti(lookup_ti_string (ut, termtype, unibi_delete_line));
+  e->str.ech    = compile_ti(require_ti_string(ut, termtype, unibi_erase_chars, "ech"));
+  e->str.el     = compile_ti(lookup_ti_string (ut, termtype, unibi_clr_eol));
+  e->str.ed     = compile_ti(lookup_ti_string (ut, termtype, unibi_clr_eos));
+  e->str.rep    = compile_ti(lookup_ti_string (ut, termtype, unibi_repeat_char));
+  e->str.smacs  = compile_ti(lookup_ti_string (ut, termtype, unibi_enter_alt_charset_mode));
+  e->str.rmacs  = compile_ti(lookup_ti_string (ut, termtype, unibi_exit_alt_charset_mode));
+  e->str.enacs  = compile_ti(lookup_ti_string (ut, termtype, unibi_ena_acs));
+  e->cap.acsc    = lookup_ti_string (ut, termtype, unibi_acs_chars);
+  e->str.ed2    = compile_ti(require_ti_string(ut, termtype, unibi_clear_screen, "ed2"));
+  e->str.stbm   = compile_ti(require_ti_string(ut, termtype, unibi_change_scroll_region, "stbm"));
+  e->str.sgr    = compile_ti(require_ti_string(ut, termtype, unibi_set_attributes, "sgr"));
+  e->str.sgr_fg = compile_ti(require_ti_string(ut, termtype, unibi_set_a_foreground, "sgr_fg"));
+  e->str.sgr_bg = compile_ti(require_ti_string(ut, termtype, unibi_set_a_background, "sgr_bg"));
+
+  e->str.sm_csr = compile_ti(require_ti_string(ut, termtype, unibi_cursor_normal, "sm_csr"));
+  e->str.rm_csr = compile_ti(require_ti_string(ut, termtype, unibi_cursor_invisible, "rm_csr"));
+
+  const char *key_mouse = lookup_ti_string(ut, termtype, unibi_key_mouse);
+  if(key_mouse && strcmp(key_mouse, "\e[M") == 0)
+    e->extra = &extra_strings_vt200_mouse;
+  else
+    e->extra = &extra_strings_default;
+
+  return e;
+}
+
+static struct TIEntry *acquire_entry(const char *termtype)
+{
+  pthread_mutex_lock(&ti_cache_mutex);
+
+  struct TIEntry **ep, *e;
+  for(ep = &ti_cache; (e = *ep); ep = &e->next)
+    if(strcmp(e->termtype, termtype) == 0)
+      break;
+
+  if(e)
+    *ep = e->next;
+  else if(!(e = new_entry(termtype))) {
+    pthread_mutex_unlock(&ti_cache_mutex);
+    return NULL;
+  }
+
+  e->next = ti_cache;
+  ti_cache = e;
+  e->refcount++;
+
+  pthread_mutex_unlock(&ti_cache_mutex);
+  return e;
+}
+
+static void release_entry(struct TIEntry *e)
+{
+  pthread_mutex_lock(&ti_cache_mutex);
+
+  if(--e->refcount) {
+    pthread_mutex_unlock(&ti_cache_mutex);
+    return;
+  }
+
+  /* Free the least recently used idle entry once there are too many */
+  struct TIEntry **ep, **lru = NULL;
+  int idle = 0;
+  for(ep = &ti_cache; *ep; ep = &(*ep)->next)
+    if(!(*ep)->refcount) {
+      idle++;
+      lru = ep;
+    }
+
+  if(idle > TI_CACHE_IDLE_MAX) {
+    struct TIEntry *victim = *lru;
+    *lru = victim->next;
+    free_entry(victim);
+  }
+
+  pthread_mutex_unlock(&ti_cache_mutex);
+}
+
 struct TIDriver {
   TickitTermDriver driver;
 
-  unibi_term *ut;
+  struct TIEntry *entry;
 
   struct {
     unsigned int altscreen:1;
     unsigned int cursorvis:1;
     unsigned int mouse:1;
+    unsigned int acs_enabled:1;
   } mode;
 
-  struct {
-    unsigned int bce:1;
-    int colours;
-  } cap;
-
-  struct {
-    // Positioning
-    const char *cup;  // cursor_address
-    const char *vpa;  // row_address == vertical position absolute
-    const char *hpa;  // column_address = horizontal position absolute
-
-    // Moving
-    const char *cuu; const char *cuu1; // Cursor Up
-    const char *cud; const char *cud1; // Cursor Down
-    const char *cuf; const char *cuf1; // Cursor Forward == Right
-    const char *cub; const char *cub1; // Cursor Backward == Left
-
-    // Editing
-    const char *ich; const char *ich1; // Insert Character
-    const char *dch; const char *dch1; // Delete Character
-    const char *il;  const char *il1;  // Insert Line
-    const char *dl;  const char *dl1;  // Delete Line
-    const char *ech;                   // Erase Character
-    const char *ed2;                   // Erase Data 2 == Clear screen
-    const char *stbm;                  // Set Top/Bottom Margins
-
-    // Formatting
-    const char *sgr;    // Select Graphic Rendition
-    const char *sgr_fg; // SGR foreground colour
-    const char *sgr_bg; // SGR background colour
-
-    // Mode setting/clearing
-    const char *sm_csr; const char *rm_csr; // Set/reset mode: Cursor visible
-  } str;
-
+  /* Copied from the entry, saving a pointer chase on every output */
+  struct TICap cap;
+  struct TIStr str;
   const struct TermInfoExtraStrings *extra;
 };
 
@@ -125,36 +390,199 @@ static void print(TickitTermDriver *ttd, const char *str, size_t len)
   tickit_termdrv_write_str(ttd, str, len);
 }
 
-static void run_ti(TickitTermDriver *ttd, const char *str, int n_params, ...)
+static void run_ti(TickitTermDriver *ttd, const TIString *ts, int n_params, ...)
 {
-  unibi_var_t params[9];
+  unibi_var_t params[9] = { { 0 } };
   va_list args;
 
-  if(!str) {
+  if(!ts) {
     fprintf(stderr, "Abort on attempt to use NULL TI string\n");
     abort();
   }
 
   va_start(args, n_params);
-  for(int i = 0; i < 10 && i < n_params; i++)
+  for(int i = 0; i < 9 && i < n_params; i++)
     params[i].i = va_arg(args, int);
+  va_end(args);
+
+  if(ts->n_params >= 0) {
+    if(ts->incr)
+      params[0].i++, params[1].i++;
+
+    char *buf = tickit_termdrv_reserve(ttd, ts->totallen + ts->n_params * 11);
+    char *s = buf;
+    const char *lit = ts->lit;
+
+    for(int i = 0; ; i++) {
+      memcpy(s, lit, ts->litlen[i]);
+      s   += ts->litlen[i];
+      lit += ts->litlen[i];
+
+      if(i == ts->n_params)
+        break;
+
+      s = put_int(s, params[ts->param[i]].i);
+    }
+
+    tickit_termdrv_commit(ttd, s - buf);
+    return;
+  }
+
+  /* Expand straight into the output; most strings fit in 64 bytes */
+  char *buf = tickit_termdrv_reserve(ttd, 64);
+  size_t len = unibi_run(ts->str, params, buf, 64);
+
+  if(len > 64) {
+    buf = tickit_termdrv_reserve(ttd, len);
+    unibi_run(ts->str, params, buf, len);
+  }
+
+  tickit_termdrv_commit(ttd, len);
+}
+
+/* Number of bytes the TI string would expand to */
+static size_t ti_len(const TIString *ts, int p1, int p2)
+{
+  unibi_var_t params[9] = { { .i = p1 }, { .i = p2 } };
+
+  if(ts->n_params >= 0) {
+    if(ts->incr)
+      params[0].i++, params[1].i++;
+
+    size_t len = ts->totallen;
+    for(int i = 0; i < ts->n_params; i++)
+      len += int_len(params[ts->param[i]].i);
+    return len;
+  }
 
   char tmp[64];
-  char *buf = tmp;
-  size_t len = unibi_run(str, params, buf, sizeof(tmp));
 
-  if(len > sizeof(tmp)) {
-    buf = tickit_termdrv_get_tmpbuffer(ttd, len);
-    unibi_run(str, params, buf, len);
+  return unibi_run(ts->str, params, tmp, sizeof(tmp));
+}
+
+static size_t move_rel_cost(struct TIDriver *td, int downward, int rightward)
+{
+  size_t cost = 0;
+
+  if(downward == 1 && td->str.cud1)
+    cost += ti_len(td->str.cud1, 0, 0);
+  else if(downward == -1 && td->str.cuu1)
+    cost += ti_len(td->str.cuu1, 0, 0);
+  else if(downward > 0)
+    cost += ti_len(td->str.cud, downward, 0);
+  else if(downward < 0)
+    cost += ti_len(td->str.cuu, -downward, 0);
+
+  if(rightward == 1 && td->str.cuf1)
+    cost += ti_len(td->str.cuf1, 0, 0);
+  else if(rightward == -1 && td->str.cub1)
+    cost += ti_len(td->str.cub1, 0, 0);
+  else if(rightward > 0)
+    cost += ti_len(td->str.cuf, rightward, 0);
+  else if(rightward < 0)
+    cost += ti_len(td->str.cub, -rightward, 0);
+
+  return cost;
+}
+
+static bool printrep(TickitTermDriver *ttd, const char *str, size_t len, int count)
+{
+  struct TIDriver *td = (struct TIDriver*)ttd;
+
+  /* The rep string takes the character as a %c parameter, so can only
+   * repeat single bytes
+   */
+  if(!td->str.rep || len != 1 || (unsigned char)str[0] >= 0x80)
+    return false;
+
+  if(ti_len(td->str.rep, str[0], count) >= count)
+    return false;
+
+  run_ti(ttd, td->str.rep, 2, str[0], count);
+  return true;
+}
+
+static void move_rel(TickitTermDriver *ttd, int downward, int rightward);
+
+/* Moves the cursor from a known position by whichever combination of the
+ * terminal's relative and absolute movements takes fewest bytes, in the
+ * manner of curses' mvcur(). Returns false if cup is no worse.
+ */
+static bool goto_planned(struct TIDriver *td, int curline, int curcol, int line, int col)
+{
+  TickitTermDriver *ttd = (TickitTermDriver *)td;
+
+  enum { V_NONE, V_REL, V_VPA } vmove = V_NONE;
+  enum { H_NONE, H_REL, H_HPA, H_CR, H_CR_CUF } hmove = H_NONE;
+  size_t vcost = 0, hcost = 0, cost;
+
+  if(line != curline) {
+    vmove = V_REL;
+    vcost = move_rel_cost(td, line - curline, 0);
+    if(td->str.vpa && (cost = ti_len(td->str.vpa, line, 0)) <= vcost)
+      vmove = V_VPA, vcost = cost;
   }
 
-  tickit_termdrv_write_str(ttd, buf, len);
+  if(col != curcol) {
+    hmove = H_REL;
+    hcost = move_rel_cost(td, 0, col - curcol);
+    if(td->str.cr) {
+      cost = ti_len(td->str.cr, 0, 0);
+      if(col == 0 && cost < hcost)
+        hmove = H_CR, hcost = cost;
+      else if(col > 0 && cost + move_rel_cost(td, 0, col) < hcost)
+        hmove = H_CR_CUF, hcost = cost + move_rel_cost(td, 0, col);
+    }
+    if(td->str.hpa && (cost = ti_len(td->str.hpa, col, 0)) <= hcost)
+      hmove = H_HPA, hcost = cost;
+  }
+
+  if(line != curline && col != curcol &&
+     vcost + hcost >= ti_len(td->str.cup, line, col))
+    return false;
+
+  switch(vmove) {
+    case V_NONE:
+      break;
+    case V_REL:
+      move_rel(ttd, line - curline, 0);
+      break;
+    case V_VPA:
+      run_ti(ttd, td->str.vpa, 1, line);
+      break;
+  }
+
+  switch(hmove) {
+    case H_NONE:
+      break;
+    case H_REL:
+      move_rel(ttd, 0, col - curcol);
+      break;
+    case H_CR:
+      run_ti(ttd, td->str.cr, 0);
+      break;
+    case H_CR_CUF:
+      run_ti(ttd, td->str.cr, 0);
+      move_rel(ttd, 0, col);
+      break;
+    case H_HPA:
+      run_ti(ttd, td->str.hpa, 1, col);
+      break;
+  }
+
+  return true;
 }
 
 static bool goto_abs(TickitTermDriver *ttd, int line, int col)
 {
   struct TIDriver *td = (struct TIDriver*)ttd;
 
+  int curline, curcol;
+  if(tickit_termdrv_get_cursor(ttd, &curline, &curcol) &&
+     goto_planned(td, curline, curcol,
+       line == -1 ? curline : line, col == -1 ? curcol : col))
+    return true;
+
   if(line != -1 && col != -1)
     run_ti(ttd, td->str.cup, 2, line, col);
   else if(line != -1) {
@@ -254,6 +682,31 @@ static bool scrollrect(TickitTermDriver *ttd, const TickitRect *rect, int downwa
   return false;
 }
 
+/* Erasing fills with the current background colour only if the terminal can
+ * do bce, so without it we can only erase when no background is set. Even
+ * then, only erase if we're not in reverse-video mode. Most terminals don't do
+ * rv+ECH properly
+ */
+static bool can_erase(struct TIDriver *td)
+{
+  TickitPen *pen = tickit_termdrv_current_pen((TickitTermDriver *)td);
+
+  if(tickit_pen_get_bool_attr(pen, TICKIT_PEN_REVERSE))
+    return false;
+
+  return td->cap.bce || tickit_pen_get_colour_attr(pen, TICKIT_PEN_BG) == -1;
+}
+
+static void write_spaces(TickitTermDriver *ttd, int count)
+{
+  if(count > 1 && printrep(ttd, " ", 1, count))
+    return;
+
+  char *spaces = tickit_termdrv_reserve(ttd, count);
+  memset(spaces, ' ', count);
+  tickit_termdrv_commit(ttd, count);
+}
+
 static void erasech(TickitTermDriver *ttd, int count, TickitMaybeBool moveend)
 {
   struct TIDriver *td = (struct TIDriver *)ttd;
@@ -261,29 +714,86 @@ static void erasech(TickitTermDriver *ttd, int count, TickitMaybeBool moveend)
   if(count < 1)
     return;
 
-  /* Even if the terminal can do bce, only use ECH if we're not in
-   * reverse-video mode. Most terminals don't do rv+ECH properly
-   */
-  if(td->cap.bce && !tickit_pen_get_bool_attr(tickit_termdrv_current_pen(ttd), TICKIT_PEN_REVERSE)) {
-    run_ti(ttd, td->str.ech, 1, count);
+  if(can_erase(td)) {
+    int line, col, cols;
+    tickit_term_get_size(ttd->tt, NULL, &cols);
 
-    if(moveend == TICKIT_MOVE_YES)
-      move_rel(ttd, 0, count);
-  }
-  else {
-     /* TODO: consider tickit_termdrv_write_chrfill(ttd, c, n)
+    /* Spaces are only safe when we know they stop short of the right-hand
+     * edge, and el only when we know the region reaches it
      */
-    char *spaces = tickit_termdrv_get_tmpbuffer(ttd, 64);
-    memset(spaces, ' ', 64);
-    while(count > 64) {
-      tickit_termdrv_write_str(ttd, spaces, 64);
-      count -= 64;
+    if(!tickit_termdrv_get_cursor(ttd, &line, &col))
+      col = -1;
+
+    if(td->str.el && col != -1 && col + count >= cols && moveend != TICKIT_YES) {
+      run_ti(ttd, td->str.el, 0);
+      return;
     }
-    tickit_termdrv_write_str(ttd, spaces, count);
 
-    if(moveend == TICKIT_MOVE_NO)
-      move_rel(ttd, 0, -count);
+    size_t echcost   = ti_len(td->str.ech, count, 0) +
+                       (moveend == TICKIT_YES ? move_rel_cost(td, 0, count) : 0);
+    size_t spacecost = count +
+                       (moveend == TICKIT_NO ? move_rel_cost(td, 0, -count) : 0);
+
+    if(col == -1 || col + count >= cols || echcost <= spacecost) {
+      run_ti(ttd, td->str.ech, 1, count);
+
+      if(moveend == TICKIT_YES)
+        move_rel(ttd, 0, count);
+      return;
+    }
   }
+
+  write_spaces(ttd, count);
+
+  if(moveend == TICKIT_NO)
+    move_rel(ttd, 0, -count);
+}
+
+static bool print_acs(TickitTermDriver *ttd, const char *acs, size_t len)
+{
+  struct TIDriver *td = (struct TIDriver *)ttd;
+
+  if(!td->str.smacs || !td->str.rmacs || !td->cap.acsc)
+    return false;
+
+  /* acsc lists pairs of the VT100 character and what this terminal sends
+   * for it */
+  char *buf = tickit_termdrv_get_tmpbuffer(ttd, len);
+  for(size_t i = 0; i < len; i++) {
+    const char *pair;
+    for(pair = td->cap.acsc; pair[0] && pair[1]; pair += 2)
+      if(pair[0] == acs[i])
+        break;
+
+    if(!pair[0] || !pair[1])
+      return false;
+
+    buf[i] = pair[1];
+  }
+
+  /* Some terminals only set up the line-drawing set once asked to */
+  if(!td->mode.acs_enabled) {
+    if(td->str.enacs)
+      run_ti(ttd, td->str.enacs, 0);
+    td->mode.acs_enabled = 1;
+  }
+
+  run_ti(ttd, td->str.smacs, 0);
+  tickit_termdrv_write_str(ttd, buf, len);
+  run_ti(ttd, td->str.rmacs, 0);
+
+  return true;
+}
+
+static bool erase_below(TickitTermDriver *ttd)
+{
+  struct TIDriver *td = (struct TIDriver *)ttd;
+
+  if(!td->str.ed || !can_erase(td))
+    return false;
+
+  run_ti(ttd, td->str.ed, 0);
+  return true;
 }
 
 static void clear(TickitTermDriver *ttd)
@@ -297,6 +807,10 @@ static void chpen(TickitTermDriver *ttd, const TickitPen *delta, const TickitPen
 {
   struct TIDriver *td = (struct TIDriver *)ttd;
 
+  /* sgr always resets everything, so only run it when something changed */
+  if(!tickit_pen_is_nonempty(delta))
+    return;
+
   /* TODO: This is all a bit of a mess
    * Would be nicer to detect if fg/bg colour are changed, and if not, use
    * the individual enter/exit modes from the delta pen
@@ -397,7 +911,7 @@ static int setctl_str(TickitTermDriver *ttd, TickitTermCtl ctl, const char *valu
 static void attach(TickitTermDriver *ttd, TickitTerm *tt)
 {
   struct TIDriver *td = (struct TIDriver *)ttd;
-  unibi_term *ut = td->ut;
+  unibi_term *ut = td->entry->ut;
 
   tickit_term_set_size(tt, unibi_get_num(ut, unibi_lines), unibi_get_num(ut, unibi_columns));
 }
@@ -423,7 +937,7 @@ static void destroy(TickitTermDriver *ttd)
 {
   struct TIDriver *td = (struct TIDriver *)ttd;
 
-  unibi_destroy(td->ut);
+  release_entry(td->entry);
 
   free(td);
 }
@@ -443,60 +957,30 @@ static TickitTermDriverVTable ti_vtable = {
   .getctl_int = getctl_int,
   .setctl_int = setctl_int,
   .setctl_str = setctl_str,
+  .printrep   = printrep,
+  .erase_below = erase_below,
+  .print_acs  = print_acs,
 };
 
 static TickitTermDriver *new(const char *termtype)
 {
-  unibi_term *ut = unibi_from_term(termtype);
-  if(!ut)
+  struct TIEntry *e = acquire_entry(termtype);
+  if(!e)
     return NULL;
 
   struct TIDriver *td = malloc(sizeof(struct TIDriver));
   td->driver.vtable = &ti_vtable;
 
-  td->ut = ut;
+  td->entry = e;
 
   td->mode.mouse = 0;
   td->mode.cursorvis = 1;
   td->mode.altscreen = 0;
+  td->mode.acs_enabled = 0;
 
-  td->cap.bce = unibi_get_bool(ut, unibi_back_color_erase);
-  td->cap.colours = unibi_get_num(ut, unibi_max_colors);
-
-  td->str.cup    = require_ti_string(ut, termtype, unibi_cursor_address, "cup");
-  td->str.vpa    = lookup_ti_string (ut, termtype, unibi_row_address);
-  td->str.hpa    = lookup_ti_string (ut, termtype, unibi_column_address);
-  td->str.cuu    = require_ti_string(ut, termtype, unibi_parm_up_cursor, "cuu");
-  td->str.cuu1   = lookup_ti_string (ut, termtype, unibi_cursor_up);
-  td->str.cud    = require_ti_string(ut, termtype, unibi_parm_down_cursor, "cud");
-  td->str.cud1   = lookup_ti_string (ut, termtype, unibi_cursor_down);
-  td->str.cuf    = require_ti_string(ut, termtype, unibi_parm_right_cursor, "cuf");
-  td->str.cuf1   = lookup_ti_string (ut, termtype, unibi_cursor_right);
-  td->str.cub    = require_ti_string(ut, termtype, unibi_parm_left_cursor, "cub");
-  td->str.cub1   = lookup_ti_string (ut, termtype, unibi_cursor_left);
-  td->str.ich    = require_ti_string(ut, termtype, unibi_parm_ich, "ich");
-  td->str.ich1   = lookup_ti_string (ut, termtype, unibi_insert_character);
-  td->str.dch    = require_ti_string(ut, termtype, unibi_parm_dch, "dch");
-  td->str.dch1   = lookup_ti_string (ut, termtype, unibi_delete_character);
-  td->str.il     = require_ti_string(ut, termtype, unibi_parm_insert_line, "il");
-  td->str.il1    = lookup_ti_string (ut, termtype, unibi_insert_line);
-  td->str.dl     = require_ti_string(ut, termtype, unibi_parm_delete_line, "dl");
-  td->str.dl1    = lookup_ti_string (ut, termtype, unibi_delete_line);
-  td->str.ech    = require_ti_string(ut, termtype, unibi_erase_chars, "ech");
-  td->str.ed2    = require_ti_string(ut, termtype, unibi_clear_screen, "ed2");
-  td->str.stbm   = require_ti_string(ut, termtype, unibi_change_scroll_region, "stbm");
-  td->str.sgr    = require_ti_string(ut, termtype, unibi_set_attributes, "sgr");
-  td->str.sgr_fg = require_ti_string(ut, termtype, unibi_set_a_foreground, "sgr_fg");
-  td->str.sgr_bg = require_ti_string(ut, termtype, unibi_set_a_background, "sgr_bg");
-
-  td->str.sm_csr = require_ti_string(ut, termtype, unibi_cursor_normal, "sm_csr");
-  td->str.rm_csr = require_ti_string(ut, termtype, unibi_cursor_invisible, "rm_csr");
-
-  const char *key_mouse = lookup_ti_string(ut, termtype, unibi_key_mouse);
-  if(key_mouse && strcmp(key_mouse, "\e[M") == 0)
-    td->extra = &extra_strings_vt200_mouse;
-  else
-    td->extra = &extra_strings_default;
+  td->cap   = e->cap;
+  td->str   = e->str;
+  td->extra = e->extra;
 
   return (TickitTermDriver*)td;
 }
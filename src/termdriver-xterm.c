@@ -1,4 +1,9 @@
+/* We need strdup() */
+#define _XOPEN_SOURCE 600
+
 #include "termdriver.h"
+#include "pen.h"
+#include "capscache.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -6,11 +11,25 @@
 
 #define strneq(a,b,n) (strncmp(a,b,n)==0)
 
+/* Longest SGR sequence; CSI 0; then 12 parameters each of up to 3 digits
+ * and a separator, then m */
+#define SGR_MAX 56
+
+#define SGR_CACHE_SIZE 64
+
+struct SgrCacheEntry {
+  uint64_t delta, final; /* pen_pack() of the pens */
+  unsigned char len;     /* 0 if unused */
+  char sgr[SGR_MAX];
+};
+
 struct XTermDriver {
   TickitTermDriver driver;
 
+  struct SgrCacheEntry sgr_cache[SGR_CACHE_SIZE];
+
   int dcs_offset;
-  char dcs_buffer[16];
+  char dcs_buffer[64];
 
   struct {
     unsigned int altscreen:1;
@@ -24,6 +43,8 @@ struct XTermDriver {
   struct {
     unsigned int cursorshape:1;
     unsigned int slrm:1;
+    unsigned int syncupdate:1;
+    unsigned int rep:1;
   } cap;
 
   struct {
@@ -32,6 +53,28 @@ struct XTermDriver {
     unsigned int cursorshape:2;
     unsigned int slrm:1;
   } initialised;
+
+  unsigned int capschanged:1; // since TICKIT_EV_CAPS was last raised
+
+  /* Which of cap the terminal has answered for itself, rather than them
+   * having come from the capability cache */
+  struct {
+    unsigned int cursorshape:1;
+    unsigned int slrm:1;
+    unsigned int syncupdate:1;
+    unsigned int rep:1;
+  } confirmed;
+
+  char *termtype;
+
+  struct {
+    unsigned int enabled:1;
+    unsigned int started:1;  // start() has been called
+    unsigned int loaded:1;   // cap came from the cache
+    unsigned int awaiting:1; // the DA2 query has been sent
+    char ident[32];
+    char caps[64];
+  } capscache;
 };
 
 static void print(TickitTermDriver *ttd, const char *str, size_t len)
@@ -39,16 +82,165 @@ static void print(TickitTermDriver *ttd, const char *str, size_t len)
   tickit_termdrv_write_str(ttd, str, len);
 }
 
+/* Length of CSI n final, where n is omitted if it is the default of 1 */
+static int csi1_len(int n)
+{
+  return n == 1 ? 3 : 3 + termdrv_uint_len(n);
+}
+
+static bool printrep(TickitTermDriver *ttd, const char *str, size_t len, int count)
+{
+  struct XTermDriver *xd = (struct XTermDriver *)ttd;
+
+  if(!xd->cap.rep || !len)
+    return false;
+
+  /* REP repeats only the single preceding graphic character */
+  unsigned char b0 = str[0];
+  size_t seqlen = b0 < 0x80 ? 1 : b0 < 0xe0 ? 2 : b0 < 0xf0 ? 3 : 4;
+  if(seqlen != len)
+    return false;
+
+  if(len + csi1_len(count - 1) >= len * count)
+    return false;
+
+  tickit_termdrv_write_str(ttd, str, len);
+  tickit_termdrv_write_csi(ttd, "b", 1, count - 1 == 1 ? -1 : count - 1);
+
+  return true;
+}
+
+static bool print_acs(TickitTermDriver *ttd, const char *acs, size_t len)
+{
+  /* The DEC Special Graphics set only replaces 0x5f to 0x7e */
+  for(size_t i = 0; i < len; i++)
+    if(acs[i] < 0x5f || acs[i] > 0x7e)
+      return false;
+
+  // SCS G0 = DEC Special Graphics
+  tickit_termdrv_write_str(ttd, "\e(0", 3);
+
+  /* REP repeats whatever glyph the preceding byte drew, so it still works
+   * in line-drawing mode */
+  for(size_t i = 0; i < len; ) {
+    size_t run = 1;
+    while(i + run < len && acs[i + run] == acs[i])
+      run++;
+
+    if(run == 1 || !printrep(ttd, acs + i, 1, run))
+      tickit_termdrv_write_str(ttd, acs + i, run);
+
+    i += run;
+  }
+
+  // SCS G0 = US ASCII
+  tickit_termdrv_write_str(ttd, "\e(B", 3);
+
+  return true;
+}
+
+static void write_spaces(TickitTermDriver *ttd, int count)
+{
+  if(count > 1 && printrep(ttd, " ", 1, count))
+    return;
+
+  char *spaces = tickit_termdrv_reserve(ttd, count);
+  memset(spaces, ' ', count);
+  tickit_termdrv_commit(ttd, count);
+}
+
+static void move_rel(TickitTermDriver *ttd, int downward, int rightward);
+
+/* Moves the cursor from a known position by whichever combination of
+ * relative and absolute movements takes fewest bytes, in the manner of
+ * curses' mvcur(). LF is not considered because the tty may translate it
+ * into CRLF. Returns false if an absolute CUP is no worse.
+ */
+static bool goto_planned(TickitTermDriver *ttd, int curline, int curcol, int line, int col)
+{
+  enum { V_NONE, V_REL, V_VPA } vmove = V_NONE;
+  enum { H_NONE, H_REL, H_BS, H_HPA, H_CR, H_CR_CUF } hmove = H_NONE;
+  int vcost = 0, hcost = 0;
+
+  if(line != curline) {
+    vmove = V_REL;
+    vcost = csi1_len(abs(line - curline));
+    if(3 + termdrv_uint_len(line + 1) <= vcost)
+      vmove = V_VPA, vcost = 3 + termdrv_uint_len(line + 1);
+  }
+
+  if(col != curcol) {
+    hmove = H_REL;
+    hcost = csi1_len(abs(col - curcol));
+    if(col < curcol && curcol - col <= 3 && curcol - col < hcost)
+      hmove = H_BS, hcost = curcol - col;
+    if(col == 0 && 1 < hcost)
+      hmove = H_CR, hcost = 1;
+    else if(col > 0 && 1 + csi1_len(col) < hcost)
+      hmove = H_CR_CUF, hcost = 1 + csi1_len(col);
+    if(csi1_len(col + 1) <= hcost)
+      hmove = H_HPA, hcost = csi1_len(col + 1);
+  }
+
+  int cupcost = col > 0 ? 4 + termdrv_uint_len(line + 1) + termdrv_uint_len(col + 1)
+                        : 3 + termdrv_uint_len(line + 1);
+  if(line != curline && col != curcol && vcost + hcost >= cupcost)
+    return false;
+
+  switch(vmove) {
+    case V_NONE:
+      break;
+    case V_REL:
+      move_rel(ttd, line - curline, 0);
+      break;
+    case V_VPA:
+      tickit_termdrv_write_csi(ttd, "d", 1, line+1);
+      break;
+  }
+
+  switch(hmove) {
+    case H_NONE:
+      break;
+    case H_REL:
+      move_rel(ttd, 0, col - curcol);
+      break;
+    case H_BS:
+      tickit_termdrv_write_str(ttd, "\b\b\b", curcol - col);
+      break;
+    case H_CR:
+      tickit_termdrv_write_str(ttd, "\r", 1);
+      break;
+    case H_CR_CUF:
+      tickit_termdrv_write_str(ttd, "\r", 1);
+      move_rel(ttd, 0, col);
+      break;
+    case H_HPA:
+      if(col > 0)
+        tickit_termdrv_write_csi(ttd, "G", 1, col+1);
+      else
+        tickit_termdrv_write_str(ttd, "\e[G", 3);
+      break;
+  }
+
+  return true;
+}
+
 static bool goto_abs(TickitTermDriver *ttd, int line, int col)
 {
+  int curline, curcol;
+  if(tickit_termdrv_get_cursor(ttd, &curline, &curcol) &&
+     goto_planned(ttd, curline, curcol,
+       line == -1 ? curline : line, col == -1 ? curcol : col))
+    return true;
+
   if(line != -1 && col > 0)
-    tickit_termdrv_write_strf(ttd, "\e[%d;%dH", line+1, col+1);
+    tickit_termdrv_write_csi(ttd, "H", 2, line+1, col+1);
   else if(line != -1 && col == 0)
-    tickit_termdrv_write_strf(ttd, "\e[%dH", line+1);
+    tickit_termdrv_write_csi(ttd, "H", 1, line+1);
   else if(line != -1)
-    tickit_termdrv_write_strf(ttd, "\e[%dd", line+1);
+    tickit_termdrv_write_csi(ttd, "d", 1, line+1);
   else if(col > 0)
-    tickit_termdrv_write_strf(ttd, "\e[%dG", col+1);
+    tickit_termdrv_write_csi(ttd, "G", 1, col+1);
   else if(col != -1)
     tickit_termdrv_write_str(ttd, "\e[G", 3);
 
@@ -58,22 +250,22 @@ static bool goto_abs(TickitTermDriver *ttd, int line, int col)
 static void move_rel(TickitTermDriver *ttd, int downward, int rightward)
 {
   if(downward > 1)
-    tickit_termdrv_write_strf(ttd, "\e[%dB", downward);
+    tickit_termdrv_write_csi(ttd, "B", 1, downward);
   else if(downward == 1)
     tickit_termdrv_write_str(ttd, "\e[B", 3);
   else if(downward == -1)
     tickit_termdrv_write_str(ttd, "\e[A", 3);
   else if(downward < -1)
-    tickit_termdrv_write_strf(ttd, "\e[%dA", -downward);
+    tickit_termdrv_write_csi(ttd, "A", 1, -downward);
 
   if(rightward > 1)
-    tickit_termdrv_write_strf(ttd, "\e[%dC", rightward);
+    tickit_termdrv_write_csi(ttd, "C", 1, rightward);
   else if(rightward == 1)
     tickit_termdrv_write_str(ttd, "\e[C", 3);
   else if(rightward == -1)
     tickit_termdrv_write_str(ttd, "\e[D", 3);
   else if(rightward < -1)
-    tickit_termdrv_write_strf(ttd, "\e[%dD", -rightward);
+    tickit_termdrv_write_csi(ttd, "D", 1, -rightward);
 }
 
 static bool scrollrect(TickitTermDriver *ttd, const TickitRect *rect, int downward, int rightward)
@@ -94,52 +286,52 @@ static bool scrollrect(TickitTermDriver *ttd, const TickitRect *rect, int downwa
   if(((xd->cap.slrm && rect->lines == 1) || (right == term_cols))
       && downward == 0) {
     if(right < term_cols)
-      tickit_termdrv_write_strf(ttd, "\e[;%ds", right);
+      tickit_termdrv_write_csi(ttd, "s", 2, -1, right);
 
     for(int line = rect->top; line < tickit_rect_bottom(rect); line++) {
       goto_abs(ttd, line, rect->left);
       if(rightward > 1)
-        tickit_termdrv_write_strf(ttd, "\e[%dP", rightward);  /* DCH */
+        tickit_termdrv_write_csi(ttd, "P", 1, rightward);  /* DCH */
       else if(rightward == 1)
         tickit_termdrv_write_str(ttd, "\e[P", 3);             /* DCH1 */
       else if(rightward == -1)
         tickit_termdrv_write_str(ttd, "\e[@", 3);             /* ICH1 */
       else if(rightward < -1)
-        tickit_termdrv_write_strf(ttd, "\e[%d@", -rightward); /* ICH */
+        tickit_termdrv_write_csi(ttd, "@", 1, -rightward); /* ICH */
     }
 
     if(right < term_cols)
-      tickit_termdrv_write_strf(ttd, "\e[s");
+      tickit_termdrv_write_str(ttd, "\e[s", 3);
 
     return true;
   }
 
   if(xd->cap.slrm ||
      (rect->left == 0 && rect->cols == term_cols && rightward == 0)) {
-    tickit_termdrv_write_strf(ttd, "\e[%d;%dr", rect->top + 1, tickit_rect_bottom(rect));
+    tickit_termdrv_write_csi(ttd, "r", 2, rect->top + 1, tickit_rect_bottom(rect));
 
     if(rect->left > 0 || right < term_cols)
-      tickit_termdrv_write_strf(ttd, "\e[%d;%ds", rect->left + 1, right);
+      tickit_termdrv_write_csi(ttd, "s", 2, rect->left + 1, right);
 
     goto_abs(ttd, rect->top, rect->left);
 
     if(downward > 1)
-      tickit_termdrv_write_strf(ttd, "\e[%dM", downward);  /* DL */
+      tickit_termdrv_write_csi(ttd, "M", 1, downward);  /* DL */
     else if(downward == 1)
       tickit_termdrv_write_str(ttd, "\e[M", 3);            /* DL1 */
     else if(downward == -1)
       tickit_termdrv_write_str(ttd, "\e[L", 3);            /* IL1 */
     else if(downward < -1)
-      tickit_termdrv_write_strf(ttd, "\e[%dL", -downward); /* IL */
+      tickit_termdrv_write_csi(ttd, "L", 1, -downward); /* IL */
 
     if(rightward > 1)
-      tickit_termdrv_write_strf(ttd, "\e[%d'~", rightward);  /* DECDC */
+      tickit_termdrv_write_csi(ttd, "'~", 1, rightward);  /* DECDC */
     else if(rightward == 1)
       tickit_termdrv_write_str(ttd, "\e['~", 4);             /* DECDC1 */
     else if(rightward == -1)
       tickit_termdrv_write_str(ttd, "\e['}", 4);             /* DECIC1 */
     if(rightward < -1)
-      tickit_termdrv_write_strf(ttd, "\e[%d'}", -rightward); /* DECIC */
+      tickit_termdrv_write_csi(ttd, "'}", 1, -rightward); /* DECIC */
 
     tickit_termdrv_write_str(ttd, "\e[r", 3);
 
@@ -157,37 +349,54 @@ static void erasech(TickitTermDriver *ttd, int count, TickitMaybeBool moveend)
   if(count < 1)
     return;
 
-  /* Only use ECH if we're not in reverse-video mode. xterm doesn't do rv+ECH
-   * properly
+  /* Only use ECH or EL if we're not in reverse-video mode. xterm doesn't do
+   * rv+ECH properly
    */
   if(!tickit_pen_get_bool_attr(tickit_termdrv_current_pen(ttd), TICKIT_PEN_REVERSE)) {
-    if(count == 1)
-      tickit_termdrv_write_str(ttd, "\e[X", 3);
-    else
-      tickit_termdrv_write_strf(ttd, "\e[%dX", count);
+    int line, col, cols;
+    tickit_term_get_size(ttd->tt, NULL, &cols);
 
-    if(moveend == TICKIT_YES)
-      move_rel(ttd, 0, count);
-  }
-  else {
-     /* TODO: consider tickit_termdrv_write_chrfill(ttd, c, n)
+    /* Spaces are only safe when we know they stop short of the right-hand
+     * edge, and EL only when we know the region reaches it
      */
-    char *spaces = tickit_termdrv_get_tmpbuffer(ttd, 64);
-    memset(spaces, ' ', 64);
-    while(count > 64) {
-      tickit_termdrv_write_str(ttd, spaces, 64);
-      count -= 64;
+    if(!tickit_termdrv_get_cursor(ttd, &line, &col))
+      col = -1;
+
+    if(col != -1 && col + count >= cols && moveend != TICKIT_YES) {
+      tickit_termdrv_write_str(ttd, "\e[K", 3); /* EL */
+      return;
     }
-    tickit_termdrv_write_str(ttd, spaces, count);
 
-    if(moveend == TICKIT_NO)
-      move_rel(ttd, 0, -count);
+    int echcost   = csi1_len(count) + (moveend == TICKIT_YES ? csi1_len(count) : 0);
+    int spacecost = count + (moveend == TICKIT_NO ? csi1_len(count) : 0);
+
+    if(col == -1 || col + count >= cols || echcost <= spacecost) {
+      tickit_termdrv_write_csi(ttd, "X", 1, count == 1 ? -1 : count);
+
+      if(moveend == TICKIT_YES)
+        move_rel(ttd, 0, count);
+      return;
+    }
   }
+
+  write_spaces(ttd, count);
+
+  if(moveend == TICKIT_NO)
+    move_rel(ttd, 0, -count);
+}
+
+static bool erase_below(TickitTermDriver *ttd)
+{
+  if(tickit_pen_get_bool_attr(tickit_termdrv_current_pen(ttd), TICKIT_PEN_REVERSE))
+    return false;
+
+  tickit_termdrv_write_str(ttd, "\e[J", 3);
+  return true;
 }
 
 static void clear(TickitTermDriver *ttd)
 {
-  tickit_termdrv_write_strf(ttd, "\e[2J", 4);
+  tickit_termdrv_write_str(ttd, "\e[2J", 4);
 }
 
 static struct SgrOnOff { int on, off; } sgr_onoff[] = {
@@ -202,16 +411,15 @@ static struct SgrOnOff { int on, off; } sgr_onoff[] = {
   {  5, 25 }, /* blink */
 };
 
-static void chpen(TickitTermDriver *ttd, const TickitPen *delta, const TickitPen *final)
+/* Collects the SGR parameters to set the attributes of pen given by mask.
+ * There can be at most 12; 3 from each of 2 colours, and 6 single attributes
+ */
+static int sgr_params(const TickitPen *pen, unsigned int mask, int params[12])
 {
-  /* There can be at most 12 SGR parameters; 3 from each of 2 colours, and
-   * 6 single attributes
-   */
-  int params[12];
   int pindex = 0;
 
   for(TickitPenAttr attr = 0; attr < TICKIT_N_PEN_ATTRS; attr++) {
-    if(!tickit_pen_has_attr(delta, attr))
+    if(!(mask & PEN_ATTR_BIT(attr)))
       continue;
 
     struct SgrOnOff *onoff = &sgr_onoff[attr];
@@ -221,7 +429,7 @@ static void chpen(TickitTermDriver *ttd, const TickitPen *delta, const TickitPen
     switch(attr) {
     case TICKIT_PEN_FG:
     case TICKIT_PEN_BG:
-      val = tickit_pen_get_colour_attr(delta, attr);
+      val = tickit_pen_get_colour_attr(pen, attr);
       if(val < 0)
         params[pindex++] = onoff->off;
       else if(val < 8)
@@ -229,14 +437,14 @@ static void chpen(TickitTermDriver *ttd, const TickitPen *delta, const TickitPen
       else if(val < 16)
         params[pindex++] = onoff->on+60 + val-8;
       else {
-        params[pindex++] = (onoff->on+8) | 0x80000000;
-        params[pindex++] = 5 | 0x80000000;
+        params[pindex++] = onoff->on+8;
+        params[pindex++] = 5;
         params[pindex++] = val;
       }
       break;
 
     case TICKIT_PEN_ALTFONT:
-      val = tickit_pen_get_int_attr(delta, attr);
+      val = tickit_pen_get_int_attr(pen, attr);
       if(val < 0 || val >= 10)
         params[pindex++] = onoff->off;
       else
@@ -249,7 +457,7 @@ static void chpen(TickitTermDriver *ttd, const TickitPen *delta, const TickitPen
     case TICKIT_PEN_REVERSE:
     case TICKIT_PEN_STRIKE:
     case TICKIT_PEN_BLINK:
-      val = tickit_pen_get_bool_attr(delta, attr);
+      val = tickit_pen_get_bool_attr(pen, attr);
       params[pindex++] = val ? onoff->on : onoff->off;
       break;
 
@@ -258,33 +466,110 @@ static void chpen(TickitTermDriver *ttd, const TickitPen *delta, const TickitPen
     }
   }
 
-  if(pindex == 0)
+  return pindex;
+}
+
+/* Renders a CSI ... m string into buffer, optionally starting with a reset,
+ * returning its length. buffer must have room for SGR_MAX bytes.
+ */
+static size_t sgr_render(char *buffer, bool reset, const int *params, int pindex)
+{
+  char *s = buffer;
+
+  *s++ = '\e';
+  *s++ = '[';
+  if(reset && pindex)
+    *s++ = '0', *s++ = ';';
+
+  for(int i = 0; i < pindex; i++) {
+    int val = params[i];
+    /* TODO: Work out what terminals support :s */
+    if(i)
+      *s++ = ';';
+    s = termdrv_put_uint(s, val);
+  }
+  *s++ = 'm';
+
+  return s - buffer;
+}
+
+static unsigned int sgr_cache_index(uint64_t delta, uint64_t final)
+{
+  uint64_t hash = delta * 0x9E3779B97F4A7C15ULL ^ final * 0xC2B2AE3D27D4EB4FULL;
+  return (hash >> 32) % SGR_CACHE_SIZE;
+}
+
+static void chpen(TickitTermDriver *ttd, const TickitPen *delta, const TickitPen *final)
+{
+  struct XTermDriver *xd = (struct XTermDriver *)ttd;
+
+  if(!delta->valid)
     return;
 
-  /* If we're going to clear all the attributes then empty SGR is neater */
-  if(!tickit_pen_is_nondefault(final))
-    pindex = 0;
+  /* The delta and final pens together determine the output, so cache the
+   * rendered SGR keyed on both
+   */
+  uint64_t deltakey = pen_pack(delta), finalkey = pen_pack(final);
+  struct SgrCacheEntry *entry = &xd->sgr_cache[sgr_cache_index(deltakey, finalkey)];
 
-  /* Render params[] into a CSI string */
+  if(!entry->len || entry->delta != deltakey || entry->final != finalkey) {
+    int params[12];
+    char deltasgr[SGR_MAX];
 
-  size_t len = 3; /* ESC [ ... m */
-  for(int i = 0; i < pindex; i++)
-    len += snprintf(NULL, 0, "%d", params[i]&0x7fffffff) + 1;
-  if(pindex > 0)
-    len--; /* Last one has no final separator */
+    size_t deltalen = sgr_render(deltasgr, false, params, sgr_params(delta, delta->valid, params));
 
-  char *buffer = tickit_termdrv_get_tmpbuffer(ttd, len + 1);
-  char *s = buffer;
+    /* Alternatively, reset everything and set just the non-default
+     * attributes of the final pen; use whichever is shorter
+     */
+    unsigned int nondefault = 0;
+    for(TickitPenAttr attr = 0; attr < TICKIT_N_PEN_ATTRS; attr++)
+      if(tickit_pen_nondefault_attr(final, attr))
+        nondefault |= PEN_ATTR_BIT(attr);
 
-  s += sprintf(s, "\e[");
-  for(int i = 0; i < pindex-1; i++)
-    /* TODO: Work out what terminals support :s */
-    s += sprintf(s, "%d%c", params[i]&0x7fffffff, ';');
-  if(pindex > 0)
-    s += sprintf(s, "%d", params[pindex-1]&0x7fffffff);
-  sprintf(s, "m");
+    entry->len = sgr_render(entry->sgr, true, params, sgr_params(final, nondefault, params));
+
+    if(deltalen < entry->len) {
+      memcpy(entry->sgr, deltasgr, deltalen);
+      entry->len = deltalen;
+    }
+
+    entry->delta = deltakey;
+    entry->final = finalkey;
+  }
+
+  tickit_termdrv_write_str(ttd, entry->sgr, entry->len);
+}
+
+static void load_capscache(struct XTermDriver *xd)
+{
+  if(!tickit_capscache_load(xd->termtype,
+        xd->capscache.ident, sizeof xd->capscache.ident,
+        xd->capscache.caps, sizeof xd->capscache.caps))
+    return;
+
+  int cursorshape, slrm, syncupdate, rep;
+  if(sscanf(xd->capscache.caps, "decscusr=%d,slrm=%d,sync=%d,rep=%d",
+        &cursorshape, &slrm, &syncupdate, &rep) != 4)
+    return;
+
+  xd->cap.cursorshape = !!cursorshape;
+  xd->cap.slrm        = !!slrm;
+  xd->cap.syncupdate  = !!syncupdate;
+  xd->cap.rep         = !!rep;
+
+  xd->capscache.loaded = 1;
+}
+
+/* Ask for the terminal's identity by DA2. The query is sent after all the
+ * others, and terminals answer in order, so by the time the reply arrives
+ * every other reply that is going to has done so too.
+ */
+static void query_identity(TickitTermDriver *ttd)
+{
+  struct XTermDriver *xd = (struct XTermDriver *)ttd;
 
-  tickit_termdrv_write_str(ttd, buffer, len);
+  tickit_termdrv_write_str(ttd, "\e[>c", 4);
+  xd->capscache.awaiting = 1;
 }
 
 static bool getctl_int(TickitTermDriver *ttd, TickitTermCtl ctl, int *value)
@@ -320,6 +605,10 @@ static bool getctl_int(TickitTermDriver *ttd, TickitTermCtl ctl, int *value)
       *value = 256;
       return true;
 
+    case TICKIT_TERMCTL_CAPS_CACHE:
+      *value = xd->capscache.enabled;
+      return true;
+
     default:
       return false;
   }
@@ -374,10 +663,14 @@ static bool setctl_int(TickitTermDriver *ttd, TickitTermCtl ctl, int value)
       /* Modes 1000, 1002 and 1003 are mutually exclusive; enabling any one
        * disables the other two
        */
-      if(!value)
-        tickit_termdrv_write_strf(ttd, "\e[?%dl\e[?1006l", mode_for_mouse(xd->mode.mouse));
-      else
-        tickit_termdrv_write_strf(ttd, "\e[?%dh\e[?1006h", mode_for_mouse(value));
+      if(!value) {
+        tickit_termdrv_write_csi(ttd, "?l", 1, mode_for_mouse(xd->mode.mouse));
+        tickit_termdrv_write_str(ttd, "\e[?1006l", 8);
+      }
+      else {
+        tickit_termdrv_write_csi(ttd, "?h", 1, mode_for_mouse(value));
+        tickit_termdrv_write_str(ttd, "\e[?1006h", 8);
+      }
 
       xd->mode.mouse = value;
       return true;
@@ -387,7 +680,7 @@ static bool setctl_int(TickitTermDriver *ttd, TickitTermCtl ctl, int value)
         return true;
 
       if(xd->cap.cursorshape)
-        tickit_termdrv_write_strf(ttd, "\e[%d q", value * 2 + (xd->mode.cursorblink ? -1 : 0));
+        tickit_termdrv_write_csi(ttd, " q", 1, value * 2 + (xd->mode.cursorblink ? -1 : 0));
       xd->mode.cursorshape = value;
       return true;
 
@@ -398,6 +691,18 @@ static bool setctl_int(TickitTermDriver *ttd, TickitTermCtl ctl, int value)
       tickit_termdrv_write_strf(ttd, value ? "\e=" : "\e>");
       return true;
 
+    case TICKIT_TERMCTL_CAPS_CACHE:
+      if(!xd->capscache.enabled == !value)
+        return true;
+
+      xd->capscache.enabled = !!value;
+
+      /* Too late to start from the cache, but what the probes find can still
+       * be saved */
+      if(value && xd->capscache.started && !xd->capscache.awaiting)
+        query_identity(ttd);
+      return true;
+
     default:
       return false;
   }
@@ -425,6 +730,15 @@ static bool setctl_str(TickitTermDriver *ttd, TickitTermCtl ctl, const char *val
 
 static void start(TickitTermDriver *ttd)
 {
+  struct XTermDriver *xd = (struct XTermDriver *)ttd;
+
+  xd->capscache.started = 1;
+
+  /* Start out with what this terminal was found to support last time; the
+   * queries below still go out, to confirm it */
+  if(xd->capscache.enabled)
+    load_capscache(xd);
+
   // Enable DECSLRM
   tickit_termdrv_write_strf(ttd, "\e[?69h");
 
@@ -434,6 +748,15 @@ static void start(TickitTermDriver *ttd)
   // Also query the current cursor visibility, blink status, and shape
   tickit_termdrv_write_strf(ttd, "\e[?25$p\e[?12$p\eP$q q\e\\");
 
+  // Find out if synchronized output is supported
+  tickit_termdrv_write_strf(ttd, "\e[?2026$p");
+
+  // Ask for the "rep" capability by XTGETTCAP, to see if REP is supported
+  tickit_termdrv_write_strf(ttd, "\eP+q726570\e\\");
+
+  if(xd->capscache.enabled)
+    query_identity(ttd);
+
   /* Some terminals (e.g. xfce4-terminal) don't understand DECRQM and print
    * the raw bytes directly as output, while still claiming to be TERM=xterm
    * It doens't hurt at this point to clear the current line just in case.
@@ -445,12 +768,33 @@ static bool started(TickitTermDriver *ttd)
 {
   struct XTermDriver *xd = (struct XTermDriver *)ttd;
 
+  if(xd->capscache.loaded)
+    return true;
+
   return xd->initialised.cursorvis &&
          xd->initialised.cursorblink &&
          xd->initialised.cursorshape &&
          xd->initialised.slrm;
 }
 
+/* Updates a capability from a reply, noting whether it changed */
+#define SET_CAP(xd, name, value)          \
+  do {                                    \
+    if((xd)->cap.name != !!(value)) {     \
+      (xd)->cap.name = !!(value);         \
+      (xd)->capschanged = 1;              \
+    }                                     \
+  } while(0)
+
+static void notify_caps(struct XTermDriver *xd)
+{
+  if(!xd->capschanged)
+    return;
+
+  xd->capschanged = 0;
+  tickit_termdrv_caps_changed((TickitTermDriver *)xd);
+}
+
 static void gotkey_modereport(struct XTermDriver *xd, int initial, int mode, int value)
 {
   if(initial == '?') // DEC mode
@@ -466,9 +810,13 @@ static void gotkey_modereport(struct XTermDriver *xd, int initial, int mode, int
         xd->initialised.cursorvis = 1;
         break;
       case 69: // DECVSSM
-        if(value == 1 || value == 2)
-          xd->cap.slrm = 1;
+        SET_CAP(xd, slrm, value == 1 || value == 2);
         xd->initialised.slrm = 1;
+        xd->confirmed.slrm = 1;
+        break;
+      case 2026: // Synchronized output
+        SET_CAP(xd, syncupdate, value == 1 || value == 2);
+        xd->confirmed.syncupdate = 1;
         break;
     }
 }
@@ -481,12 +829,75 @@ static void gotkey_decrqss(struct XTermDriver *xd, char status, char *args, size
       // value==1 or 2 => shape == 1, 3 or 4 => 2, etc..
       int shape = (value+1) / 2;
       xd->mode.cursorshape = shape;
-      xd->cap.cursorshape = 1;
+      SET_CAP(xd, cursorshape, 1);
     }
+    else
+      SET_CAP(xd, cursorshape, 0);
     xd->initialised.cursorshape = 1;
+    xd->confirmed.cursorshape = 1;
+  }
+}
+
+static void gotkey_xtgettcap(struct XTermDriver *xd, char status, char *args, size_t arglen)
+{
+  if(arglen >= 6 && strneq(args, "726570", 6) && (arglen == 6 || args[6] == '=')) { // rep
+    SET_CAP(xd, rep, status == '1');
+    xd->confirmed.rep = 1;
   }
 }
 
+static void gotkey_da2(struct XTermDriver *xd, long args[], size_t nargs)
+{
+  xd->capscache.awaiting = 0;
+
+  if(!xd->capscache.enabled)
+    return;
+
+  /* Every reply is in by now, so whatever the cache said about anything not
+   * answered was wrong */
+  if(!xd->confirmed.cursorshape)
+    SET_CAP(xd, cursorshape, 0);
+  if(!xd->confirmed.slrm)
+    SET_CAP(xd, slrm, 0);
+  if(!xd->confirmed.syncupdate)
+    SET_CAP(xd, syncupdate, 0);
+  if(!xd->confirmed.rep)
+    SET_CAP(xd, rep, 0);
+
+  char ident[sizeof xd->capscache.ident];
+  size_t len = 0;
+
+  ident[0] = 0;
+  for(size_t i = 0; i < nargs && len < sizeof ident; i++) {
+    int n;
+    if(args[i] >= 0)
+      n = snprintf(ident + len, sizeof ident - len, i ? ";%ld" : "%ld", args[i]);
+    else
+      n = snprintf(ident + len, sizeof ident - len, i ? ";" : "");
+    if(n < 0)
+      break;
+    len += n;
+  }
+  if(len >= sizeof ident || !len)
+    return;
+
+  char caps[sizeof xd->capscache.caps];
+  snprintf(caps, sizeof caps, "decscusr=%d,slrm=%d,sync=%d,rep=%d",
+      xd->cap.cursorshape, xd->cap.slrm, xd->cap.syncupdate, xd->cap.rep);
+
+  /* Only touch the file if something changed */
+  if(xd->capscache.loaded &&
+     strcmp(ident, xd->capscache.ident) == 0 &&
+     strcmp(caps, xd->capscache.caps) == 0)
+    return;
+
+  tickit_capscache_save(xd->termtype, ident, caps);
+
+  strcpy(xd->capscache.ident, ident);
+  strcpy(xd->capscache.caps, caps);
+  xd->capscache.loaded = 1;
+}
+
 static int gotkey(TickitTermDriver *ttd, TermKey *tk, const TermKeyKey *key)
 {
   struct XTermDriver *xd = (struct XTermDriver *)ttd;
@@ -495,6 +906,21 @@ static int gotkey(TickitTermDriver *ttd, TermKey *tk, const TermKeyKey *key)
     int initial, mode, value;
     termkey_interpret_modereport(tk, key, &initial, &mode, &value);
     gotkey_modereport(xd, initial, mode, value);
+    notify_caps(xd);
+
+    return 1;
+  }
+  else if(key->type == TERMKEY_TYPE_UNKNOWN_CSI && xd->capscache.awaiting) {
+    long args[16];
+    size_t nargs = 16;
+    unsigned long cmd;
+
+    if(termkey_interpret_csi(tk, key, args, &nargs, &cmd) != TERMKEY_RES_KEY ||
+       cmd != ('>' << 8 | 'c'))
+      return 0;
+
+    gotkey_da2(xd, args, nargs);
+    notify_caps(xd);
 
     return 1;
   }
@@ -526,8 +952,11 @@ static int gotkey(TickitTermDriver *ttd, TermKey *tk, const TermKeyKey *key)
 
     if(cmdlen == 3 && strneq(xd->dcs_buffer + 1, "$r", 2))
       gotkey_decrqss(xd, xd->dcs_buffer[0], xd->dcs_buffer + cmdlen, xd->dcs_offset - cmdlen);
+    else if(cmdlen == 3 && strneq(xd->dcs_buffer + 1, "+r", 2))
+      gotkey_xtgettcap(xd, xd->dcs_buffer[0], xd->dcs_buffer + cmdlen, xd->dcs_offset - cmdlen);
 
     xd->dcs_offset = -1;
+    notify_caps(xd);
 
     return 1;
   }
@@ -535,6 +964,22 @@ static int gotkey(TickitTermDriver *ttd, TermKey *tk, const TermKeyKey *key)
   return 0;
 }
 
+static void begin_frame(TickitTermDriver *ttd)
+{
+  struct XTermDriver *xd = (struct XTermDriver *)ttd;
+
+  if(xd->cap.syncupdate)
+    tickit_termdrv_write_str(ttd, "\e[?2026h", 8);
+}
+
+static void end_frame(TickitTermDriver *ttd)
+{
+  struct XTermDriver *xd = (struct XTermDriver *)ttd;
+
+  if(xd->cap.syncupdate)
+    tickit_termdrv_write_str(ttd, "\e[?2026l", 8);
+}
+
 static void stop(TickitTermDriver *ttd)
 {
   struct XTermDriver *xd = (struct XTermDriver *)ttd;
@@ -553,6 +998,7 @@ static void destroy(TickitTermDriver *ttd)
 {
   struct XTermDriver *xd = (struct XTermDriver *)ttd;
 
+  free(xd->termtype);
   free(xd);
 }
 
@@ -572,6 +1018,11 @@ static TickitTermDriverVTable xterm_vtable = {
   .setctl_int = setctl_int,
   .setctl_str = setctl_str,
   .gotkey     = gotkey,
+  .begin_frame = begin_frame,
+  .end_frame  = end_frame,
+  .printrep   = printrep,
+  .erase_below = erase_below,
+  .print_acs  = print_acs,
 };
 
 static TickitTermDriver *new(const char *termtype)
@@ -597,6 +1048,14 @@ static TickitTermDriver *new(const char *termtype)
   memset(&xd->cap, 0, sizeof xd->cap);
 
   memset(&xd->initialised, 0, sizeof xd->initialised);
+  memset(&xd->confirmed, 0, sizeof xd->confirmed);
+  xd->capschanged = 0;
+
+  xd->termtype = strdup(termtype);
+  memset(&xd->capscache, 0, sizeof xd->capscache);
+
+  for(int i = 0; i < SGR_CACHE_SIZE; i++)
+    xd->sgr_cache[i].len = 0;
 
   return (TickitTermDriver*)xd;
 }
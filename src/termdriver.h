@@ -1,6 +1,43 @@
 #include "tickit.h"
 #include "tickit-termdrv.h"
 
+/* Writes the decimal digits of val at s, returning a pointer just past the
+ * last one. This avoids going through printf for the many small integers in
+ * control sequences. s must have room for at least 10 bytes.
+ */
+static inline char *termdrv_put_uint(char *s, unsigned int val)
+{
+  if(val < 10) {
+    *s++ = '0' + val;
+    return s;
+  }
+  if(val < 100) {
+    *s++ = '0' + val / 10;
+    *s++ = '0' + val % 10;
+    return s;
+  }
+
+  char digits[10];
+  int n = 0;
+  while(val) {
+    digits[n++] = '0' + val % 10;
+    val /= 10;
+  }
+  while(n)
+    *s++ = digits[--n];
+
+  return s;
+}
+
+/* Returns the number of digits termdrv_put_uint() would write */
+static inline int termdrv_uint_len(unsigned int val)
+{
+  int len = 1;
+  while(val >= 10)
+    len++, val /= 10;
+  return len;
+}
+
 typedef struct {
   TickitTermDriver *(*new)(const char *termtype);
 } TickitTermDriverProbe;
@@ -0,0 +1,159 @@
+/* We need poll() and pthreads */
+#define _POSIX_C_SOURCE 200112L
+
+#include "termwriter.h"
+#include "spscring.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct TickitTermWriter {
+  int fd;
+  TickitTermWriterPolicy policy;
+
+  TickitSpscRing ring;
+
+  pthread_t thread;
+};
+
+static void *writer_main(void *data)
+{
+  TickitTermWriter *tw = data;
+  TickitSpscRing *ring = &tw->ring;
+  size_t tail = ring->tail;
+
+  while(1) {
+    size_t head = tickit_spscring_wait_data(ring, tail);
+    if(head == tail)
+      break;
+
+    /* Write as much as is contiguous before the end of the ring */
+    size_t offs = tail & (ring->size - 1);
+    size_t len = head - tail;
+    if(len > ring->size - offs)
+      len = ring->size - offs;
+
+    ssize_t written = write(tw->fd, ring->buf + offs, len);
+    if(written < 0) {
+      if(errno == EINTR)
+        continue;
+      if(errno == EAGAIN || errno == EWOULDBLOCK) {
+        struct pollfd pfd = { .fd = tw->fd, .events = POLLOUT };
+        poll(&pfd, 1, -1);
+        continue;
+      }
+
+      /* Any other error; the output is lost */
+      written = len;
+    }
+
+    tail += written;
+    tickit_spscring_consume(ring, tail);
+  }
+
+  return NULL;
+}
+
+TickitTermWriter *tickit_termwriter_new(int fd, size_t size, TickitTermWriterPolicy policy)
+{
+  TickitTermWriter *tw = malloc(sizeof(TickitTermWriter));
+  if(!tw)
+    return NULL;
+
+  if(!tickit_spscring_init(&tw->ring, size)) {
+    free(tw);
+    return NULL;
+  }
+
+  tw->fd     = fd;
+  tw->policy = policy;
+
+  if(pthread_create(&tw->thread, NULL, writer_main, tw) != 0) {
+    tickit_spscring_fini(&tw->ring);
+    free(tw);
+    return NULL;
+  }
+
+  return tw;
+}
+
+void tickit_termwriter_destroy(TickitTermWriter *tw)
+{
+  tickit_spscring_stop(&tw->ring);
+
+  pthread_join(tw->thread, NULL);
+
+  tickit_spscring_fini(&tw->ring);
+  free(tw);
+}
+
+/* Returns false if there isn't room for len bytes and the policy is to drop
+ * rather than wait for it */
+static bool make_room(TickitTermWriter *tw, size_t len)
+{
+  if(len <= tickit_spscring_room(&tw->ring))
+    return true;
+  if(tw->policy == TICKIT_TERM_WRITER_DROP)
+    return false;
+
+  tickit_spscring_wait_room(&tw->ring, len);
+  return true;
+}
+
+bool tickit_termwriter_writev(TickitTermWriter *tw, const struct iovec *iov, int iovcnt)
+{
+  TickitSpscRing *ring = &tw->ring;
+
+  size_t total = 0;
+  for(int i = 0; i < iovcnt; i++)
+    total += iov[i].iov_len;
+
+  if(total <= ring->size) {
+    if(!make_room(tw, total))
+      return false;
+
+    size_t head = ring->head;
+    for(int i = 0; i < iovcnt; i++) {
+      tickit_spscring_copy_in(ring, head, iov[i].iov_base, iov[i].iov_len);
+      head += iov[i].iov_len;
+    }
+
+    tickit_spscring_publish(ring, head);
+    return true;
+  }
+
+  if(tw->policy == TICKIT_TERM_WRITER_DROP)
+    return false;
+
+  /* Too big for the ring at all, so feed it through in pieces */
+  for(int i = 0; i < iovcnt; i++) {
+    const char *bytes = iov[i].iov_base;
+    size_t len = iov[i].iov_len;
+
+    while(len) {
+      size_t chunk = len < ring->size ? len : ring->size;
+      make_room(tw, chunk);
+
+      tickit_spscring_copy_in(ring, ring->head, bytes, chunk);
+      tickit_spscring_publish(ring, ring->head + chunk);
+
+      bytes += chunk;
+      len   -= chunk;
+    }
+  }
+
+  return true;
+}
+
+bool tickit_termwriter_write(TickitTermWriter *tw, const char *bytes, size_t len)
+{
+  return tickit_termwriter_writev(tw, &(struct iovec){ (void *)bytes, len }, 1);
+}
+
+size_t tickit_termwriter_pending(TickitTermWriter *tw)
+{
+  return tickit_spscring_pending(&tw->ring);
+}
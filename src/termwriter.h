@@ -0,0 +1,20 @@
+#include "tickit.h"
+
+#include <sys/uio.h>
+
+/* A background thread writing to a file descriptor, fed through a
+ * single-producer/single-consumer ring buffer. Only the thread that created
+ * it may call the functions below other than _pending().
+ */
+typedef struct TickitTermWriter TickitTermWriter;
+
+TickitTermWriter *tickit_termwriter_new(int fd, size_t size, TickitTermWriterPolicy policy);
+/* Waits for everything already queued to be written */
+void tickit_termwriter_destroy(TickitTermWriter *tw);
+
+/* All or nothing; returns false if the bytes were dropped for lack of room */
+bool tickit_termwriter_write(TickitTermWriter *tw, const char *bytes, size_t len);
+bool tickit_termwriter_writev(TickitTermWriter *tw, const struct iovec *iov, int iovcnt);
+
+/* Number of bytes queued but not yet written */
+size_t tickit_termwriter_pending(TickitTermWriter *tw);
@@ -27,8 +27,8 @@ int main(int argc, char *argv[])
   len = read(fd[0], buffer, sizeof buffer);
   buffer[len] = 0;
 
-  is_str_escape(buffer, "\e[?69h\e[?69$p\e[?25$p\e[?12$p\eP$q q\e\\\e[G\e[K",
-      "buffer after initialisation contains DECSLRM and cursor status probes");
+  is_str_escape(buffer, "\e[?69h\e[?69$p\e[?25$p\e[?12$p\eP$q q\e\\\e[?2026$p\eP+q726570\e\\\e[G\e[K",
+      "buffer after initialisation contains DECSLRM, cursor status, synchronized output and REP probes");
 
   tickit_term_print(tt, "Hello world!");
 
@@ -73,7 +73,7 @@ int main(int argc, char *argv[])
   len = read(fd[0], buffer, sizeof buffer);
   buffer[len] = 0;
 
-  is_str_escape(buffer, "\e[11G", "buffer after tickit_term_goto col");
+  is_str_escape(buffer, "\e[5C", "buffer after tickit_term_goto col");
 
   tickit_term_destroy(tt);
 
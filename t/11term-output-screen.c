@@ -108,29 +108,159 @@ int main(int argc, char *argv[])
   tickit_term_clear(tt);
   is_str_escape(buffer, "\e[H\e[J", "buffer after tickit_term_clear");
 
+  /* The cursor position is unknown after clear, so spaces might wrap at the
+   * right-hand edge and ECH is used instead */
   buffer[0] = 0;
   tickit_term_erasech(tt, 1, 0);
-  is_str_escape(buffer, " \b", "buffer after tickit_term_erasech 1 nomove");
+  is_str_escape(buffer, "\e[1X", "buffer after tickit_term_erasech 1 nomove");
 
   buffer[0] = 0;
   tickit_term_erasech(tt, 3, 0);
-  is_str_escape(buffer, "   \e[3D", "buffer after tickit_term_erasech 3 nomove");
+  is_str_escape(buffer, "\e[3X", "buffer after tickit_term_erasech 3 nomove");
 
   buffer[0] = 0;
   tickit_term_erasech(tt, 1, 1);
-  is_str_escape(buffer, " ", "buffer after tickit_term_erasech 1 move");
+  is_str_escape(buffer, "\e[1X\e[C", "buffer after tickit_term_erasech 1 move");
 
   buffer[0] = 0;
   tickit_term_erasech(tt, 3, 1);
-  is_str_escape(buffer, "   ", "buffer after tickit_term_erasech 3 move");
+  is_str_escape(buffer, "\e[3X\e[3C", "buffer after tickit_term_erasech 3 move");
 
   buffer[0] = 0;
   tickit_term_erasech(tt, 10, 1);
 
-  is_str_escape(buffer, "          ", "buffer after tickit_term_erasech 10 move");
+  is_str_escape(buffer, "\e[10X\e[10C", "buffer after tickit_term_erasech 10 move");
+
+  /* With the cursor known, the cheapest safe way is chosen */
+  tickit_term_goto(tt, 5, 10);
+
+  buffer[0] = 0;
+  tickit_term_erasech(tt, 3, TICKIT_MAYBE);
+  is_str_escape(buffer, "   ", "tickit_term_erasech 3 uses spaces where shorter than ECH");
+
+  tickit_term_goto(tt, 5, 10);
+
+  buffer[0] = 0;
+  tickit_term_erasech(tt, 20, TICKIT_MAYBE);
+  is_str_escape(buffer, "\e[20X", "tickit_term_erasech 20 uses ECH where shorter than spaces");
+
+  tickit_term_goto(tt, 5, 70);
+
+  buffer[0] = 0;
+  tickit_term_erasech(tt, 10, TICKIT_MAYBE);
+  is_str_escape(buffer, "\e[K", "tickit_term_erasech to the right-hand edge uses EL");
+
+  /* screen lacks bce, so a background colour has to be drawn with spaces */
+  TickitPen *pen = tickit_pen_new_attrs(TICKIT_PEN_BG, 4, -1);
+  tickit_term_setpen(tt, pen);
+  tickit_pen_destroy(pen);
+
+  tickit_term_goto(tt, 5, 10);
+
+  buffer[0] = 0;
+  tickit_term_erasech(tt, 20, TICKIT_MAYBE);
+  is_str_escape(buffer, "                    ", "tickit_term_erasech with background colour uses spaces");
+
+  tickit_term_goto(tt, 5, 70);
+
+  buffer[0] = 0;
+  tickit_term_erasech(tt, 10, TICKIT_MAYBE);
+  is_str_escape(buffer, "          ", "tickit_term_erasech with background colour uses spaces to the right-hand edge");
+
+  /* Strings of only literals, %i and %p%d are expanded from templates
+   * compiled when the driver was created; sgr has conditionals so still goes
+   * through unibilium, but setaf is simple enough on screen
+   */
+  pen = tickit_pen_new_attrs(TICKIT_PEN_FG, 1, TICKIT_PEN_BOLD, 1, -1);
+
+  buffer[0] = 0;
+  tickit_term_setpen(tt, pen);
+  is_str_escape(buffer, "\e[0;1m\x0f\e[31m", "buffer after setpen by interpreted sgr and compiled setaf");
+
+  buffer[0] = 0;
+  tickit_term_setpen(tt, pen);
+  is_str_escape(buffer, "", "buffer empty after setpen to the current pen");
+
+  tickit_pen_destroy(pen);
+
+  buffer[0] = 0;
+  tickit_term_goto(tt, 10, 10);
+  is_str_escape(buffer, "\e[11;11H", "buffer after goto by compiled cup");
+
+  buffer[0] = 0;
+  tickit_term_goto(tt, 10, 40);
+  is_str_escape(buffer, "\e[41G", "buffer after goto by compiled hpa");
+
+  buffer[0] = 0;
+  tickit_term_goto(tt, 2, 40);
+  is_str_escape(buffer, "\e[3d", "buffer after goto by compiled vpa");
+
+  buffer[0] = 0;
+  tickit_term_erasech(tt, 20, TICKIT_MAYBE);
+  is_str_escape(buffer, "\e[20X", "buffer after erasech by compiled ech");
+
+  /* screen only sets up G1 as the line-drawing set after enacs */
+  buffer[0] = 0;
+  ok(tickit_term_print_acs(tt, "tqu", 3), "tickit_term_print_acs succeeds");
+  is_str_escape(buffer, "\e(B\e)0\x0e" "tqu\x0f", "buffer after first tickit_term_print_acs sends enacs");
+
+  buffer[0] = 0;
+  tickit_term_print_acs(tt, "lqk", 3);
+  is_str_escape(buffer, "\x0e" "lqk\x0f", "buffer after second tickit_term_print_acs");
+
+  /* screen's cud1 is a bare linefeed, which ONLCR would turn into CR+LF, so
+   * one line down must be planned some other way */
+  tickit_term_goto(tt, 5, 12);
+
+  buffer[0] = 0;
+  tickit_term_goto(tt, 6, 12);
+  is_str_escape(buffer, "\e[7d", "buffer after goto one line down avoids linefeed");
+
+  buffer[0] = 0;
+  tickit_term_move(tt, 1, 0);
+  is_str_escape(buffer, "\e[1B", "buffer after tickit_term_move down 1 avoids linefeed");
+
+  {
+    TickitRenderBuffer *rb = tickit_renderbuffer_new(24, 80);
+    tickit_renderbuffer_text_at(rb, 5, 12, "a", NULL);
+    tickit_renderbuffer_text_at(rb, 6, 12, "b", NULL);
+    tickit_renderbuffer_text_at(rb, 7, 12, "c", NULL);
+
+    buffer[0] = 0;
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_str_escape(buffer, "\e[6d\e[0m\x0f" "a\e[7d\bb\e[8d\bc",
+        "buffer after renderbuffer flush of a single column");
+
+    tickit_renderbuffer_destroy(rb);
+  }
 
   tickit_term_destroy(tt);
   pass("tickit_term_destroy");
 
+  /* screen-256color's setaf has conditionals, so is left to unibilium */
+  tt = tickit_term_new_for_termtype("screen-256color");
+  tickit_term_set_output_func(tt, output, buffer);
+  tickit_term_set_size(tt, 24, 80);
+
+  pen = tickit_pen_new_attrs(TICKIT_PEN_FG, 100, -1);
+
+  buffer[0] = 0;
+  tickit_term_setpen(tt, pen);
+  is_str_escape(buffer, "\e[0m\x0f\e[38;5;100m", "buffer after setpen by interpreted setaf");
+
+  tickit_pen_set_colour_attr(pen, TICKIT_PEN_FG, 3);
+
+  buffer[0] = 0;
+  tickit_term_setpen(tt, pen);
+  is_str_escape(buffer, "\e[0m\x0f\e[33m", "buffer after setpen by interpreted setaf low colour");
+
+  tickit_pen_destroy(pen);
+
+  buffer[0] = 0;
+  tickit_term_goto(tt, 3, 4);
+  is_str_escape(buffer, "\e[4;5H", "buffer after goto on second terminal");
+
+  tickit_term_destroy(tt);
+
   return exit_status();
 }
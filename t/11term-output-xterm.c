@@ -44,7 +44,7 @@ int main(int argc, char *argv[])
 
   buffer[0] = 0;
   tickit_term_goto(tt, 4, -1);
-  is_str_escape(buffer, "\e[5d", "buffer after tickit_term_goto line");
+  is_str_escape(buffer, "\e[B", "buffer after tickit_term_goto line");
 
   buffer[0] = 0;
   tickit_term_goto(tt, -1, 10);
@@ -52,7 +52,43 @@ int main(int argc, char *argv[])
 
   buffer[0] = 0;
   tickit_term_goto(tt, -1, 0);
-  is_str_escape(buffer, "\e[G", "buffer after tickit_term_goto col0");
+  is_str_escape(buffer, "\r", "buffer after tickit_term_goto col0");
+
+  buffer[0] = 0;
+  tickit_term_goto(tt, 4, 0);
+  tickit_term_goto(tt, 4, 0);
+  is_str_escape(buffer, "", "buffer empty after tickit_term_goto to cursor position");
+
+  buffer[0] = 0;
+  tickit_term_print(tt, "ab\xc3\xa9");
+  tickit_term_goto(tt, 4, 3);
+  is_str_escape(buffer, "ab\xc3\xa9", "buffer after tickit_term_print advances tracked cursor");
+
+  buffer[0] = 0;
+  tickit_term_print(tt, "\r");
+  tickit_term_goto(tt, 4, 3);
+  is_str_escape(buffer, "\r\e[5;4H", "buffer after tickit_term_print control invalidates tracked cursor");
+
+  buffer[0] = 0;
+  tickit_term_goto(tt, 4, 1);
+  is_str_escape(buffer, "\b\b", "buffer after planned goto uses BS for short leftward move");
+
+  buffer[0] = 0;
+  tickit_term_goto(tt, 9, 1);
+  is_str_escape(buffer, "\e[5B", "buffer after planned goto uses CUD");
+
+  buffer[0] = 0;
+  tickit_term_goto(tt, 9, 40);
+  is_str_escape(buffer, "\e[41G", "buffer after planned goto prefers HPA to equal-cost CUF");
+
+  buffer[0] = 0;
+  tickit_term_goto(tt, 10, 0);
+  is_str_escape(buffer, "\e[B\r", "buffer after planned goto uses CUD+CR");
+
+  buffer[0] = 0;
+  tickit_term_print(tt, "\r");
+  tickit_term_goto(tt, -1, 10);
+  is_str_escape(buffer, "\r\e[11G", "buffer after goto col with unknown cursor uses HPA");
 
   buffer[0] = 0;
   tickit_term_move(tt, 1, 0);
@@ -86,6 +122,19 @@ int main(int argc, char *argv[])
   tickit_term_move(tt, 0, -2);
   is_str_escape(buffer, "\e[2D", "buffer after tickit_term_move left 2");
 
+  /* The terminal stops the cursor at the edges */
+  tickit_term_goto(tt, 23, 10);
+  buffer[0] = 0;
+  tickit_term_move(tt, 1, 0);
+  tickit_term_goto(tt, 23, 10);
+  is_str_escape(buffer, "\e[B", "buffer after tickit_term_move past the bottom edge");
+
+  tickit_term_goto(tt, 0, 79);
+  buffer[0] = 0;
+  tickit_term_move(tt, -2, 3);
+  tickit_term_goto(tt, 0, 79);
+  is_str_escape(buffer, "\e[2A\e[3C", "buffer after tickit_term_move past the top-right corner");
+
   buffer[0] = 0;
   tickit_term_scrollrect(tt, 3, 0, 7, 80, 1, 0);
   is_str_escape(buffer, "\e[4;10r\e[4H\e[M\e[r", "buffer after tickit_term_scroll lines 3-9 1 down");
@@ -157,6 +206,76 @@ int main(int argc, char *argv[])
   tickit_term_erasech(tt, 3, 1);
   is_str_escape(buffer, "\e[3X\e[3C", "buffer after tickit_term_erasech 3 move");
 
+  tickit_term_goto(tt, 5, 10);
+
+  buffer[0] = 0;
+  tickit_term_erasech(tt, 3, 1);
+  is_str_escape(buffer, "   ", "buffer after tickit_term_erasech 3 move with known cursor");
+
+  buffer[0] = 0;
+  tickit_term_erasech(tt, 67, 0);
+  is_str_escape(buffer, "\e[K", "buffer after tickit_term_erasech to right edge");
+
+  buffer[0] = 0;
+  tickit_term_erase_below(tt);
+  is_str_escape(buffer, "\e[J", "buffer after tickit_term_erase_below");
+
+  buffer[0] = 0;
+  tickit_term_begin_frame(tt);
+  tickit_term_goto(tt, 0, 0);
+  tickit_term_print(tt, "Frame");
+  is_str_escape(buffer, "", "buffer empty during frame");
+  tickit_term_end_frame(tt);
+  is_str_escape(buffer, "\e[1HFrame", "buffer after frame without synchronized output");
+
+  /* Respond to the synchronized output probe */
+  tickit_term_input_push_bytes(tt, "\e[?2026;2$y", 11);
+
+  buffer[0] = 0;
+  tickit_term_begin_frame(tt);
+  tickit_term_print(tt, "Outer");
+  tickit_term_begin_frame(tt);
+  tickit_term_print(tt, "Inner");
+  tickit_term_end_frame(tt);
+  is_str_escape(buffer, "", "buffer empty after nested end_frame");
+  tickit_term_end_frame(tt);
+  is_str_escape(buffer, "\e[?2026hOuterInner\e[?2026l", "buffer after frame with synchronized output");
+
+  buffer[0] = 0;
+  tickit_term_print(tt, "After");
+  is_str_escape(buffer, "After", "output is unbuffered again after frame");
+
+  buffer[0] = 0;
+  tickit_term_printrep(tt, "-", 1, 10);
+  is_str_escape(buffer, "----------", "buffer after tickit_term_printrep without REP");
+
+  /* Respond to the XTGETTCAP probe for rep */
+  tickit_term_input_push_bytes(tt, "\eP1+r726570=25703125635C455B257032257B317D252D256462\e\\", 54);
+
+  buffer[0] = 0;
+  tickit_term_printrep(tt, "-", 1, 10);
+  is_str_escape(buffer, "-\e[9b", "buffer after tickit_term_printrep with REP");
+
+  buffer[0] = 0;
+  tickit_term_printrep(tt, "\xe2\x94\x80", 3, 3);
+  is_str_escape(buffer, "\xe2\x94\x80\e[2b", "buffer after tickit_term_printrep of UTF-8 with REP");
+
+  buffer[0] = 0;
+  tickit_term_printrep(tt, "-", 1, 3);
+  is_str_escape(buffer, "---", "buffer after tickit_term_printrep of short run");
+
+  buffer[0] = 0;
+  ok(tickit_term_print_acs(tt, "tqu", 3), "tickit_term_print_acs succeeds");
+  is_str_escape(buffer, "\e(0tqu\e(B", "buffer after tickit_term_print_acs");
+
+  buffer[0] = 0;
+  tickit_term_print_acs(tt, "lqqqqqqqqqk", 11);
+  is_str_escape(buffer, "\e(0lq\e[8bk\e(B", "buffer after tickit_term_print_acs with REP");
+
+  buffer[0] = 0;
+  ok(!tickit_term_print_acs(tt, "+-", 2), "tickit_term_print_acs fails for non-graphics characters");
+  is_str_escape(buffer, "", "buffer empty after failed tickit_term_print_acs");
+
   tickit_term_destroy(tt);
   pass("tickit_term_destroy");
 
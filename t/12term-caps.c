@@ -0,0 +1,62 @@
+#include "tickit.h"
+#include "taplib.h"
+
+#include <string.h>
+
+void output(TickitTerm *tt, const char *bytes, size_t len, void *user)
+{
+  char *buffer = user;
+  strncat(buffer, bytes, len);
+}
+
+static int caps_events;
+
+static void on_caps(TickitTerm *tt, TickitEventType ev, TickitEvent *args, void *data)
+{
+  if(ev & TICKIT_EV_CAPS)
+    caps_events++;
+}
+
+int main(int argc, char *argv[])
+{
+  TickitTerm *tt;
+  char buffer[1024] = { 0 };
+
+  tt = tickit_term_new_for_termtype("xterm");
+  tickit_term_bind_event(tt, TICKIT_EV_CAPS, on_caps, NULL);
+  tickit_term_set_output_func(tt, output, buffer);
+  tickit_term_set_size(tt, 25, 80);
+
+  ok(!tickit_term_is_started(tt), "not started before any replies");
+
+  /* Output works straight away, without the optional features */
+  buffer[0] = 0;
+  is_int(tickit_term_scrollrect(tt, 3, 10, 5, 60, 1, 0), 0, "no DECSLRM before its reply");
+
+  tickit_term_input_push_bytes(tt, "\e[?69;1$y", 9);
+
+  is_int(caps_events, 1, "TICKIT_EV_CAPS after DECSLRM reply");
+  is_int(tickit_term_scrollrect(tt, 3, 10, 5, 60, 1, 0), 1, "DECSLRM used once the event has been raised");
+
+  tickit_term_input_push_bytes(tt, "\e[?69;1$y", 9);
+
+  is_int(caps_events, 1, "no TICKIT_EV_CAPS when nothing changed");
+
+  tickit_term_input_push_bytes(tt, "\e[?25;1$y\e[?12;2$y", 18);
+
+  is_int(caps_events, 1, "no TICKIT_EV_CAPS for mode reports");
+  ok(!tickit_term_is_started(tt), "not started while the cursor shape is unknown");
+
+  tickit_term_input_push_bytes(tt, "\eP1$r2 q\e\\", 10);
+
+  is_int(caps_events, 2, "TICKIT_EV_CAPS after DECSCUSR reply");
+  ok(tickit_term_is_started(tt), "started once all the replies are in");
+
+  tickit_term_input_push_bytes(tt, "\e[?2026;2$y", 11);
+
+  is_int(caps_events, 3, "TICKIT_EV_CAPS after synchronized output reply");
+
+  tickit_term_destroy(tt);
+
+  return exit_status();
+}
@@ -0,0 +1,120 @@
+/* We need mkdtemp() and setenv() */
+#define _POSIX_C_SOURCE 200809L
+
+#include "tickit.h"
+#include "taplib.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void output(TickitTerm *tt, const char *bytes, size_t len, void *user)
+{
+  char *buffer = user;
+  strncat(buffer, bytes, len);
+}
+
+static char path[256];
+
+static void read_cache(char *line, size_t len)
+{
+  line[0] = 0;
+
+  FILE *f = fopen(path, "r");
+  if(!f)
+    return;
+  if(!fgets(line, len, f))
+    line[0] = 0;
+  fclose(f);
+}
+
+int main(int argc, char *argv[])
+{
+  TickitTerm *tt;
+  char buffer[1024] = { 0 };
+  char line[256];
+  int value;
+
+  char dir[] = "/tmp/tickit-capscache-XXXXXX";
+  if(!mkdtemp(dir))
+    skip_all("cannot create a temporary directory");
+
+  setenv("XDG_CACHE_HOME", dir, 1);
+  snprintf(path, sizeof path, "%s/tickit/xterm", dir);
+
+  /* First time around there is nothing cached */
+  tt = tickit_term_new_for_termtype("xterm");
+
+  ok(tickit_term_setctl_int(tt, TICKIT_TERMCTL_CAPS_CACHE, 1), "tickit_term_setctl_int CAPS_CACHE");
+  ok(tickit_term_getctl_int(tt, TICKIT_TERMCTL_CAPS_CACHE, &value) && value == 1, "tickit_term_getctl_int CAPS_CACHE");
+
+  tickit_term_set_output_func(tt, output, buffer);
+
+  is_str_escape(buffer, "\e[?69h\e[?69$p\e[?25$p\e[?12$p\eP$q q\e\\\e[?2026$p\eP+q726570\e\\\e[>c\e[G\e[K",
+      "startup output asks for the terminal identity last");
+
+  tickit_term_input_push_bytes(tt, "\e[?69;1$y\e[?25;1$y\e[?12;2$y\eP1$r2 q\e\\\e[?2026;2$y\eP1+r726570\e\\", 61);
+
+  read_cache(line, sizeof line);
+  is_str(line, "", "nothing saved until the identity reply");
+
+  tickit_term_input_push_bytes(tt, "\e[>41;354;0c", 12);
+
+  read_cache(line, sizeof line);
+  is_str(line, "41;354;0 decscusr=1,slrm=1,sync=1,rep=1\n", "probe results saved after the identity reply");
+
+  tickit_term_destroy(tt);
+
+  /* Second time around the cached capabilities are used straight away */
+  buffer[0] = 0;
+  tt = tickit_term_new_for_termtype("xterm");
+  tickit_term_setctl_int(tt, TICKIT_TERMCTL_CAPS_CACHE, 1);
+  tickit_term_set_output_func(tt, output, buffer);
+  tickit_term_set_size(tt, 25, 80);
+
+  buffer[0] = 0;
+  is_int(tickit_term_scrollrect(tt, 3, 10, 5, 60, 1, 0), 1, "DECSLRM used from the cache before any reply");
+
+  buffer[0] = 0;
+  tickit_term_begin_frame(tt);
+  tickit_term_print(tt, "Frame");
+  tickit_term_end_frame(tt);
+  is_str_escape(buffer, "\e[?2026hFrame\e[?2026l", "synchronized output used from the cache");
+
+  /* A different terminal replies; it lacks synchronized output and REP */
+  tickit_term_input_push_bytes(tt, "\e[?69;1$y\e[?25;1$y\e[?12;2$y\eP1$r2 q\e\\\e[?2026;0$y", 48);
+
+  buffer[0] = 0;
+  tickit_term_begin_frame(tt);
+  tickit_term_print(tt, "Frame");
+  tickit_term_end_frame(tt);
+  is_str_escape(buffer, "Frame", "synchronized output no longer used once the terminal denies it");
+
+  tickit_term_input_push_bytes(tt, "\e[>1;2;0c", 9);
+
+  buffer[0] = 0;
+  tickit_term_printrep(tt, "-", 1, 10);
+  is_str_escape(buffer, "----------", "REP no longer used when the terminal never answered for it");
+
+  read_cache(line, sizeof line);
+  is_str(line, "1;2;0 decscusr=1,slrm=1,sync=0,rep=0\n", "cache updated for the new terminal");
+
+  tickit_term_destroy(tt);
+
+  /* Without opting in the cache is neither read nor written */
+  buffer[0] = 0;
+  tt = tickit_term_new_for_termtype("xterm");
+  tickit_term_set_output_func(tt, output, buffer);
+
+  ok(!strstr(buffer, "\e[>c"), "no identity query without CAPS_CACHE");
+
+  tickit_term_destroy(tt);
+
+  unlink(path);
+  snprintf(path, sizeof path, "%s/tickit", dir);
+  rmdir(path);
+  rmdir(dir);
+
+  return exit_status();
+}
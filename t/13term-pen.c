@@ -104,7 +104,41 @@ int main(int argc, char *argv[])
   buffer[0] = 0;
   tickit_term_setpen(tt, pen);
 
-  is_str_escape(buffer, "\e[39;49;4m", "setpen resets colours, enables under");
+  is_str_escape(buffer, "\e[0;4m", "setpen resets colours, enables under with shorter reset");
+
+  buffer[0] = 0;
+  tickit_term_setpen(tt, pen);
+
+  is_str_escape(buffer, "", "setpen again is a no-op");
+
+  tickit_pen_set_colour_attr(pen, TICKIT_PEN_FG, 123);
+  tickit_term_setpen(tt, pen);
+
+  buffer[0] = 0;
+  tickit_term_setpen(tt, pen);
+
+  is_str_escape(buffer, "", "setpen again with xterm256 foreground is a no-op");
+
+  {
+    TickitPen *pen_a = tickit_pen_new_attrs(TICKIT_PEN_FG, 1, TICKIT_PEN_BOLD, 1, -1);
+    TickitPen *pen_b = tickit_pen_new_attrs(TICKIT_PEN_FG, 2, -1);
+
+    tickit_term_setpen(tt, pen_a);
+
+    /* Repeated transitions are served from the SGR cache */
+    for(int i = 0; i < 2; i++) {
+      buffer[0] = 0;
+      tickit_term_setpen(tt, pen_b);
+      is_str_escape(buffer, "\e[0;32m", "setpen transition to pen_b uses shorter reset");
+
+      buffer[0] = 0;
+      tickit_term_setpen(tt, pen_a);
+      is_str_escape(buffer, "\e[31;1m", "setpen transition to pen_a");
+    }
+
+    tickit_pen_destroy(pen_a);
+    tickit_pen_destroy(pen_b);
+  }
 
   tickit_term_destroy(tt);
   return exit_status();
@@ -1,7 +1,9 @@
 #include "tickit.h"
 #include "taplib.h"
 
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 void output(TickitTerm *tt, const char *bytes, size_t len, void *user)
 {
@@ -9,6 +11,22 @@ void output(TickitTerm *tt, const char *bytes, size_t len, void *user)
   strncat(buffer, bytes, len);
 }
 
+int n_iov, n_writes;
+const void *iov_base[16];
+
+void voutput(TickitTerm *tt, const struct iovec *iov, int iovcnt, void *user)
+{
+  char *buffer = user;
+
+  n_writes++;
+  n_iov = iovcnt;
+  for(int i = 0; i < iovcnt; i++) {
+    if(i < 16)
+      iov_base[i] = iov[i].iov_base;
+    strncat(buffer, iov[i].iov_base, iov[i].iov_len);
+  }
+}
+
 int main(int argc, char *argv[])
 {
   TickitTerm *tt;
@@ -33,7 +51,141 @@ int main(int argc, char *argv[])
   tickit_term_flush(tt);
   is_str_escape(buffer, "Hello world!", "buffer contains output after flush");
 
+  // Frames are never flushed part-way, even when the buffer fills
+  tickit_term_set_output_buffer(tt, 8);
+  buffer[0] = 0;
+
+  tickit_term_begin_frame(tt);
+  tickit_term_print(tt, "This frame is longer than the buffer");
+  is_str_escape(buffer, "", "buffer empty during frame larger than output buffer");
+
+  tickit_term_end_frame(tt);
+  is_str_escape(buffer, "This frame is longer than the buffer", "buffer contains whole frame after end_frame");
+
   tickit_term_destroy(tt);
 
+  // Vectored output
+  {
+    const char *longtext = "This is a long string that will be referenced in place";
+
+    tt = tickit_term_new_for_termtype("xterm");
+    tickit_term_set_output_vfunc(tt, voutput, buffer);
+    tickit_term_set_output_vectored(tt, true);
+
+    ok(tickit_term_get_output_vectored(tt), "tickit_term_get_output_vectored");
+
+    tickit_term_flush(tt);
+    buffer[0] = 0;
+
+    tickit_term_print(tt, "A");
+    tickit_term_print(tt, "B");
+    tickit_term_printn_ref(tt, longtext, strlen(longtext));
+    tickit_term_printn_ref(tt, "C", 1);
+    is_str_escape(buffer, "", "buffer empty before vectored flush");
+
+    tickit_term_flush(tt);
+    is_str_escape(buffer, "ABThis is a long string that will be referenced in placeC",
+        "buffer contains output after vectored flush");
+    is_int(n_iov, 3, "short fragments coalesced around referenced text");
+    ok(iov_base[1] == longtext, "long text referenced without copying");
+
+    tickit_term_destroy(tt);
+  }
+
+  // Vectored output within a frame is written at end_frame
+  {
+    tt = tickit_term_new_for_termtype("xterm");
+    tickit_term_set_output_vfunc(tt, voutput, buffer);
+    tickit_term_set_output_vectored(tt, true);
+    tickit_term_set_size(tt, 25, 80);
+
+    tickit_term_flush(tt);
+    buffer[0] = 0;
+    n_writes = 0;
+
+    TickitRenderBuffer *rb = tickit_renderbuffer_new(25, 80);
+    tickit_renderbuffer_text_at(rb, 0, 0, "A renderbuffer line long enough to be referenced", NULL);
+    tickit_renderbuffer_text_at(rb, 1, 0, "and another one after it, also long enough", NULL);
+
+    tickit_term_begin_frame(tt);
+    tickit_term_print(tt, "<");
+    tickit_renderbuffer_flush_to_term(rb, tt);
+
+    /* The renderbuffer's text must not be referenced once it has gone */
+    tickit_renderbuffer_destroy(rb);
+
+    tickit_term_print(tt, ">");
+    is_int(n_writes, 0, "nothing written during vectored frame");
+
+    tickit_term_end_frame(tt);
+    is_int(n_writes, 1, "vectored frame written at once");
+    is_str_escape(buffer, "<\e[1H\e[mA renderbuffer line long enough to be referenced"
+        "\e[2Hand another one after it, also long enough>",
+        "buffer contains whole vectored frame after end_frame");
+
+    tickit_term_destroy(tt);
+  }
+
+  // Setting one kind of output function replaces the other
+  {
+    char vbuffer[1024] = { 0 };
+
+    tt = tickit_term_new_for_termtype("xterm");
+    tickit_term_set_output_func(tt, output, buffer);
+    tickit_term_set_output_vfunc(tt, voutput, vbuffer);
+    tickit_term_set_output_buffer(tt, 4096);
+
+    tickit_term_flush(tt);
+    buffer[0] = 0;
+    vbuffer[0] = 0;
+
+    tickit_term_print(tt, "flushed");
+    tickit_term_flush(tt);
+
+    tickit_term_set_output_buffer(tt, 0);
+    tickit_term_print(tt, " unbuffered");
+
+    is_str_escape(vbuffer, "flushed unbuffered", "vfunc receives all output after replacing func");
+    is_str_escape(buffer, "", "replaced func receives no output");
+
+    tickit_term_set_output_func(tt, output, buffer);
+    vbuffer[0] = 0;
+
+    tickit_term_print(tt, "plain");
+    is_str_escape(buffer, "plain", "func receives output after replacing vfunc");
+    is_str_escape(vbuffer, "", "replaced vfunc receives no output");
+
+    tickit_term_destroy(tt);
+  }
+
+  // Vectored output to fd
+  {
+    tt = tickit_term_new_for_termtype("xterm");
+    if(pipe(fd) != 0) {
+      perror("pipe");
+      exit(1);
+    }
+
+    tickit_term_set_output_vectored(tt, true);
+    tickit_term_set_output_fd(tt, fd[1]);
+
+    /* Drain the startup output */
+    tickit_term_flush(tt);
+    read(fd[0], buffer, sizeof buffer);
+
+    char longtext[] = "Another long string written to a file descriptor";
+    tickit_term_print(tt, "<");
+    tickit_term_printn_ref(tt, longtext, strlen(longtext));
+    tickit_term_print(tt, ">");
+    tickit_term_flush(tt);
+
+    size_t len = read(fd[0], buffer, sizeof(buffer) - 1);
+    buffer[len] = 0;
+    is_str_escape(buffer, "<Another long string written to a file descriptor>",
+        "fd contains output after vectored flush");
+
+    tickit_term_destroy(tt);
+  }
+
   return exit_status();
 }
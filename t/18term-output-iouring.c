@@ -0,0 +1,160 @@
+#include "tickit.h"
+#include "taplib.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define N_MANY 40
+
+static void drain_startup(TickitTerm *tt, int fd)
+{
+  char buffer[1024];
+
+  tickit_term_flush(tt);
+  read(fd, buffer, sizeof buffer);
+}
+
+static void complete_all(TickitIOUring *ring, TickitTerm *tt)
+{
+  while(tickit_term_output_pending(tt))
+    tickit_iouring_complete(ring, true);
+}
+
+int main(int argc, char *argv[])
+{
+  TickitIOUring *ring;
+  TickitTerm *tt, *tt2;
+  int infd[2], outfd[2], outfd2[2];
+  char   buffer[1024];
+  size_t len;
+
+  ring = tickit_iouring_new(8);
+  if(!ring)
+    skip_all("io_uring is not available");
+
+  pipe(infd);
+  pipe(outfd);
+  pipe(outfd2);
+
+  tt = tickit_term_new_for_termtype("xterm");
+  tickit_term_set_input_fd(tt, infd[0]);
+  tickit_term_set_output_fd(tt, outfd[1]);
+  tickit_term_set_output_buffer(tt, 1024);
+  drain_startup(tt, outfd[0]);
+
+  tt2 = tickit_term_new_for_termtype("xterm");
+  tickit_term_set_output_fd(tt2, outfd2[1]);
+  tickit_term_set_output_buffer(tt2, 1024);
+  drain_startup(tt2, outfd2[0]);
+
+  ok(tickit_iouring_get_fd(ring) >= 0, "tickit_iouring_get_fd");
+
+  ok(tickit_term_set_iouring(tt, ring), "tickit_term_set_iouring");
+  ok(tickit_term_set_iouring(tt2, ring), "tickit_term_set_iouring second terminal");
+
+  tickit_term_print(tt, "Hello");
+  tickit_term_flush(tt);
+
+  is_int(tickit_term_output_pending(tt), 5, "output pending until the ring is submitted");
+
+  tickit_iouring_submit(ring);
+  complete_all(ring, tt);
+
+  len = read(outfd[0], buffer, sizeof buffer);
+  is_int(len, 5, "read length after complete");
+  ok(memcmp(buffer, "Hello", 5) == 0, "output written by the ring");
+
+  /* Both terminals are written by one submission */
+  tickit_term_print(tt, "one");
+  tickit_term_flush(tt);
+  tickit_term_print(tt2, "two");
+  tickit_term_flush(tt2);
+
+  ok(tickit_iouring_submit(ring) >= 2, "tickit_iouring_submit has both writes in flight");
+  complete_all(ring, tt);
+  complete_all(ring, tt2);
+
+  len = read(outfd[0], buffer, sizeof buffer);
+  ok(len == 3 && memcmp(buffer, "one", 3) == 0, "first terminal output");
+  len = read(outfd2[0], buffer, sizeof buffer);
+  ok(len == 3 && memcmp(buffer, "two", 3) == 0, "second terminal output");
+
+  /* Input arrives as a completion of the read kept armed on infd */
+  write(infd[1], "x", 1);
+  ok(tickit_iouring_complete(ring, true) >= 1, "tickit_iouring_complete reaps input");
+
+  ok(!tickit_term_set_output_thread(tt, 1024, TICKIT_TERM_WRITER_BLOCK), "tickit_term_set_output_thread refused while on a ring");
+
+  ok(tickit_term_set_iouring(tt, NULL), "tickit_term_set_iouring NULL");
+
+  tickit_term_print(tt, "Direct");
+  tickit_term_flush(tt);
+
+  len = read(outfd[0], buffer, sizeof buffer);
+  ok(len == 6 && memcmp(buffer, "Direct", 6) == 0, "output written directly once detached");
+
+  /* Destroying the ring detaches any terminal still on it */
+  tickit_term_print(tt2, "Last");
+  tickit_term_flush(tt2);
+  tickit_iouring_destroy(ring);
+
+  is_int(tickit_term_output_pending(tt2), 0, "no output pending once the ring is destroyed");
+
+  tickit_term_print(tt2, "After");
+  tickit_term_flush(tt2);
+
+  len = read(outfd2[0], buffer, sizeof buffer);
+  ok(len >= 5 && memcmp(buffer + len - 5, "After", 5) == 0, "output written directly after the ring is destroyed");
+
+  tickit_term_destroy(tt);
+  tickit_term_destroy(tt2);
+
+  /* More terminals than the ring has entries; operations that don't fit
+   * wait for a later round rather than overwriting each other */
+  {
+    TickitTerm *many[N_MANY];
+    int manyin[N_MANY][2], manyout[N_MANY][2];
+
+    ring = tickit_iouring_new(4);
+
+    for(int i = 0; i < N_MANY; i++) {
+      pipe(manyin[i]);
+      pipe(manyout[i]);
+
+      many[i] = tickit_term_new_for_termtype("xterm");
+      tickit_term_set_input_fd(many[i], manyin[i][0]);
+      tickit_term_set_output_fd(many[i], manyout[i][1]);
+      tickit_term_set_output_buffer(many[i], 1024);
+      drain_startup(many[i], manyout[i][0]);
+
+      tickit_term_set_iouring(many[i], ring);
+
+      char text[16];
+      snprintf(text, sizeof text, "Term %d", i);
+      tickit_term_print(many[i], text);
+      tickit_term_flush(many[i]);
+    }
+
+    for(int i = 0; i < N_MANY; i++)
+      complete_all(ring, many[i]);
+
+    int good = 0;
+    for(int i = 0; i < N_MANY; i++) {
+      char text[16];
+      snprintf(text, sizeof text, "Term %d", i);
+      len = read(manyout[i][0], buffer, sizeof buffer);
+      if(len == strlen(text) && memcmp(buffer, text, len) == 0)
+        good++;
+    }
+    is_int(good, N_MANY, "every terminal written when there are more than the ring holds");
+
+    tickit_iouring_destroy(ring);
+    pass("tickit_iouring_destroy with many terminals");
+
+    for(int i = 0; i < N_MANY; i++)
+      tickit_term_destroy(many[i]);
+  }
+
+  return exit_status();
+}
@@ -0,0 +1,101 @@
+#include "tickit.h"
+#include "taplib.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CHUNK 4096
+
+int main(int argc, char *argv[])
+{
+  TickitTerm *tt;
+  int    fd[2];
+  char   buffer[CHUNK];
+  char   text[CHUNK];
+  size_t len;
+
+  pipe(fd);
+
+  tt = tickit_term_new_for_termtype("xterm");
+  tickit_term_set_output_fd(tt, fd[1]);
+
+  /* Drain the startup output */
+  read(fd[0], buffer, sizeof buffer);
+
+  is_int(tickit_term_output_pending(tt), 0, "tickit_term_output_pending initially 0");
+
+  fcntl(fd[1], F_SETFL, fcntl(fd[1], F_GETFL) | O_NONBLOCK);
+
+  /* Print far more than the pipe can hold */
+  for(int i = 0; i < CHUNK; i++)
+    text[i] = 'A' + (i % 26);
+
+  int chunks = 64;
+  for(int i = 0; i < chunks; i++)
+    tickit_term_printn(tt, text, CHUNK);
+
+  ok(tickit_term_output_pending(tt) > 0, "tickit_term_output_pending after filling the pipe");
+
+  size_t pending = tickit_term_output_pending(tt);
+  tickit_term_print(tt, "END");
+  is_int(tickit_term_output_pending(tt), pending + 3, "output is queued behind pending bytes");
+
+  ok(!tickit_term_is_congested(tt), "not congested without an output limit");
+
+  tickit_term_set_output_limit(tt, 1024);
+  is_int(tickit_term_get_output_limit(tt), 1024, "tickit_term_get_output_limit");
+  ok(tickit_term_is_congested(tt), "congested with pending output beyond the limit");
+
+  /* A congested renderbuffer flush merges into the next frame */
+  TickitRenderBuffer *rb = tickit_renderbuffer_new(25, 80);
+  tickit_renderbuffer_set_flush_flags(rb, TICKIT_RENDERBUFFER_FLUSH_MERGE_CONGESTED);
+
+  tickit_renderbuffer_text_at(rb, 0, 0, "old", NULL);
+  tickit_renderbuffer_translate(rb, 1, 0);
+  tickit_renderbuffer_text_at(rb, 0, 0, "kept", NULL);
+
+  pending = tickit_term_output_pending(tt);
+  tickit_renderbuffer_flush_to_term(rb, tt);
+  is_int(tickit_term_output_pending(tt), pending, "congested flush_to_term outputs nothing");
+
+  tickit_renderbuffer_text_at(rb, 0, 0, "new", NULL);
+
+  size_t total = 0;
+  int intact = 1;
+  while(1) {
+    len = read(fd[0], buffer, sizeof buffer);
+    if(len <= 0)
+      break;
+
+    for(size_t i = 0; i < len; i++)
+      if(total + i < (size_t)chunks * CHUNK && buffer[i] != text[(total + i) % CHUNK])
+        intact = 0;
+
+    total += len;
+
+    tickit_term_output_writable(tt);
+
+    if(!tickit_term_output_pending(tt) && total == (size_t)chunks * CHUNK + 3)
+      break;
+  }
+
+  is_int(total, (size_t)chunks * CHUNK + 3, "all output eventually written");
+  ok(intact, "output written in order");
+  is_int(tickit_term_output_pending(tt), 0, "tickit_term_output_pending 0 after draining");
+
+  ok(!tickit_term_is_congested(tt), "not congested after draining");
+
+  tickit_renderbuffer_flush_to_term(rb, tt);
+  len = read(fd[0], buffer, sizeof(buffer) - 1);
+  buffer[len] = 0;
+
+  ok(strstr(buffer, "new") && strstr(buffer, "kept") && !strstr(buffer, "old"),
+      "flush_to_term after draining outputs the merged frame");
+
+  tickit_renderbuffer_destroy(rb);
+
+  tickit_term_destroy(tt);
+
+  return exit_status();
+}
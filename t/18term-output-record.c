@@ -0,0 +1,146 @@
+/* We need usleep */
+#define _XOPEN_SOURCE 600
+
+#include "tickit.h"
+#include "taplib.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+static int fd[2];
+
+static char  *recorded;
+static size_t recorded_len;
+
+static void *reader(void *data)
+{
+  ssize_t len;
+
+  while((len = read(fd[0], recorded + recorded_len, 1024*1024 - 1 - recorded_len)) > 0)
+    recorded_len += len;
+
+  return NULL;
+}
+
+static void discard(TickitTerm *tt, const char *bytes, size_t len, void *user)
+{
+}
+
+static pthread_t reader_thread;
+
+static void start_reader(void)
+{
+  recorded_len = 0;
+  pthread_create(&reader_thread, NULL, reader, NULL);
+}
+
+static void finish_reader(void)
+{
+  close(fd[1]);
+  pthread_join(reader_thread, NULL);
+  close(fd[0]);
+
+  recorded[recorded_len] = 0;
+}
+
+static void session(TickitTerm *tt)
+{
+  ok(tickit_term_start_recording(tt, fd[1], 4096), "tickit_term_start_recording");
+
+  tickit_term_print(tt, "Hello");
+  tickit_term_flush(tt);
+
+  tickit_term_set_size(tt, 30, 100);
+
+  /* A UTF-8 sequence split between flushes */
+  tickit_term_printn(tt, "\xc3", 1);
+  tickit_term_flush(tt);
+  tickit_term_printn(tt, "\xa9", 1);
+  tickit_term_flush(tt);
+
+  tickit_term_printn(tt, "a\"b\\\e\xff", 6);
+  tickit_term_flush(tt);
+
+  tickit_term_stop_recording(tt);
+
+  tickit_term_print(tt, "Unrecorded");
+  tickit_term_flush(tt);
+}
+
+static void overflow(TickitTerm *tt)
+{
+  char text[1000];
+  memset(text, 'A', sizeof text);
+
+  tickit_term_start_recording(tt, fd[1], 1024);
+
+  /* Nothing reads the pipe yet, so the thread blocks once it is full and
+   * the ring fills behind it */
+  for(int i = 0; i < 200; i++) {
+    tickit_term_printn(tt, text, sizeof text);
+    tickit_term_flush(tt);
+  }
+}
+
+static void overflow_drain(TickitTerm *tt)
+{
+  /* Now the pipe is read, room is made for the marker */
+  for(int i = 0; i < 100; i++) {
+    tickit_term_print(tt, "X");
+    tickit_term_flush(tt);
+    usleep(10000);
+  }
+
+  tickit_term_stop_recording(tt);
+}
+
+int main(int argc, char *argv[])
+{
+  TickitTerm *tt;
+
+  recorded = malloc(1024*1024);
+
+  tt = tickit_term_new_for_termtype("xterm");
+  tickit_term_set_size(tt, 25, 80);
+  tickit_term_set_output_func(tt, discard, NULL);
+  tickit_term_set_output_buffer(tt, 4096);
+
+  time_t started = time(NULL);
+
+  pipe(fd);
+  start_reader();
+  session(tt);
+  finish_reader();
+
+  long long timestamp = 0;
+  int headerlen = 0;
+  sscanf(recorded, "{\"version\": 2, \"width\": 80, \"height\": 25, \"timestamp\": %lld, "
+      "\"env\": {\"TERM\": \"xterm\"}}\n%n", &timestamp, &headerlen);
+  ok(headerlen > 0, "asciicast header gives version, size and TERM");
+  ok(timestamp >= started && timestamp <= time(NULL), "asciicast header timestamp is the time recording started");
+  ok(strncmp(recorded + headerlen, "[0.", 3) == 0, "asciicast header is a whole line");
+
+  ok(strstr(recorded, ", \"o\", \"Hello\"]\n") != NULL, "output event");
+  ok(strstr(recorded, ", \"r\", \"100x30\"]\n") != NULL, "resize event");
+  ok(strstr(recorded, ", \"o\", \"\xc3\xa9\"]\n") != NULL, "UTF-8 sequence split between flushes is joined");
+  ok(strstr(recorded, ", \"o\", \"a\\\"b\\\\\\u001b\xef\xbf\xbd\"]\n") != NULL, "output is escaped for JSON");
+  ok(strstr(recorded, "Unrecorded") == NULL, "output after tickit_term_stop_recording is not recorded");
+
+  /* Events that don't fit the ring are dropped rather than waited for */
+  pipe(fd);
+  overflow(tt);
+  start_reader();
+  overflow_drain(tt);
+  finish_reader();
+
+  ok(strstr(recorded, ", \"m\", \"dropped ") != NULL, "dropped events are marked");
+
+  tickit_term_destroy(tt);
+  free(recorded);
+
+  return exit_status();
+}
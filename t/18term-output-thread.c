@@ -0,0 +1,107 @@
+#include "tickit.h"
+#include "taplib.h"
+
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CHUNK 4096
+
+static int fd[2];
+
+static void *reader(void *data)
+{
+  size_t *total = data;
+  char buffer[CHUNK];
+  ssize_t len;
+
+  while((len = read(fd[0], buffer, sizeof buffer)) > 0)
+    *total += len;
+
+  return NULL;
+}
+
+int main(int argc, char *argv[])
+{
+  TickitTerm *tt;
+  char   buffer[CHUNK];
+  char   text[CHUNK];
+  size_t len;
+
+  pipe(fd);
+
+  tt = tickit_term_new_for_termtype("xterm");
+  tickit_term_set_output_fd(tt, fd[1]);
+  tickit_term_set_output_buffer(tt, CHUNK);
+
+  /* Drain the startup output */
+  tickit_term_flush(tt);
+  read(fd[0], buffer, sizeof buffer);
+
+  ok(tickit_term_set_output_thread(tt, CHUNK, TICKIT_TERM_WRITER_DROP), "tickit_term_set_output_thread");
+
+  tickit_term_print(tt, "Hello");
+  tickit_term_flush(tt);
+
+  len = read(fd[0], buffer, sizeof buffer);
+  is_int(len, 5, "read length after flush");
+  ok(memcmp(buffer, "Hello", 5) == 0, "output written by the thread");
+
+  /* Fill the pipe and then the ring, so further flushes are dropped */
+  for(int i = 0; i < CHUNK; i++)
+    text[i] = 'A' + (i % 26);
+
+  for(int i = 0; i < 64; i++) {
+    tickit_term_printn(tt, text, CHUNK / 2);
+    tickit_term_flush(tt);
+  }
+
+  ok(tickit_term_output_dropped(tt) > 0, "tickit_term_output_dropped once the ring is full");
+  is_int(tickit_term_output_dropped(tt), 0, "tickit_term_output_dropped is reset");
+  ok(tickit_term_output_pending(tt) > 0, "tickit_term_output_pending includes the ring");
+
+  /* Once part of a frame is dropped, the rest of it is too */
+  tickit_term_begin_frame(tt);
+  tickit_term_printn(tt, text, CHUNK / 2);
+  tickit_term_flush(tt);
+  ok(tickit_term_output_dropped(tt) > 0, "tickit_term_output_dropped within a frame");
+
+  while(tickit_term_output_pending(tt) > 0)
+    read(fd[0], buffer, sizeof buffer);
+
+  tickit_term_print(tt, "Rest");
+  tickit_term_flush(tt);
+  tickit_term_end_frame(tt);
+  is_int(tickit_term_output_dropped(tt), 4, "rest of the frame dropped even once there is room");
+
+  tickit_term_begin_frame(tt);
+  tickit_term_print(tt, "Next");
+  tickit_term_end_frame(tt);
+  is_int(tickit_term_output_dropped(tt), 0, "next frame written");
+
+  /* Switching to blocking waits for room rather than dropping */
+  size_t total = 0;
+  pthread_t thread;
+  pthread_create(&thread, NULL, reader, &total);
+
+  ok(tickit_term_set_output_thread(tt, CHUNK, TICKIT_TERM_WRITER_BLOCK), "tickit_term_set_output_thread blocking");
+
+  for(int i = 0; i < 64; i++) {
+    tickit_term_printn(tt, text, CHUNK);
+    tickit_term_flush(tt);
+  }
+
+  is_int(tickit_term_output_dropped(tt), 0, "nothing dropped when blocking");
+
+  ok(tickit_term_set_output_thread(tt, 0, TICKIT_TERM_WRITER_BLOCK), "tickit_term_set_output_thread 0 stops the thread");
+  is_int(tickit_term_output_pending(tt), 0, "no output pending once the thread is stopped");
+
+  close(fd[1]);
+  pthread_join(thread, NULL);
+
+  ok(total >= 64 * CHUNK, "all of the blocking output was written");
+
+  tickit_term_destroy(tt);
+
+  return exit_status();
+}
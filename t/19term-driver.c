@@ -9,6 +9,17 @@ static void print(TickitTermDriver *ttd, const char *str, size_t len)
   tickit_termdrv_write_strf(ttd, "PRINT(%.*s)", len, str);
 }
 
+static bool goto_abs(TickitTermDriver *ttd, int line, int col)
+{
+  tickit_termdrv_write_csi(ttd, "H", 2, line == -1 ? -1 : line+1, col+1);
+  return true;
+}
+
+static void move_rel(TickitTermDriver *ttd, int downward, int rightward)
+{
+  tickit_termdrv_write_csi(ttd, "?'~", 1, rightward);
+}
+
 static int getctl_int(TickitTermDriver *ttd, TickitTermCtl ctl, int *value)
 {
   switch(ctl) {
@@ -32,9 +43,9 @@ static bool setctl_str(TickitTermDriver *ttd, TickitTermCtl ctl, const char *val
 static TickitTermDriverVTable vtable = {
   .destroy    = (void (*)(TickitTermDriver *))free,
   .print      = print,
-  /* Technically these are not optional but the test doesn't use them
   .goto_abs   = goto_abs,
   .move_rel   = move_rel,
+  /* Technically these are not optional but the test doesn't use them
   .scrollrect = scrollrect,
   .erasech    = erasech,
   .clear      = clear,
@@ -74,5 +85,43 @@ int main(int argc, char *argv[])
 
   is_str(buffer, "PRINT(Hello)", "buffer after print");
 
+  buffer[0] = 0;
+
+  memcpy(tickit_termdrv_reserve(ttd, 16), "Reserved", 8);
+  tickit_termdrv_commit(ttd, 8);
+  tickit_term_flush(tt);
+
+  is_str(buffer, "Reserved", "buffer after reserve and commit");
+
+  buffer[0] = 0;
+
+  tickit_term_goto(tt, 4, 12345);
+  tickit_term_goto(tt, -1, 0);
+  tickit_term_move(tt, 0, 7);
+  tickit_term_flush(tt);
+
+  is_str(buffer, "\e[5;12346H\e[;1H\e[?7'~", "buffer after write_csi");
+
+  tickit_term_set_output_buffer(tt, 0);
+  buffer[0] = 0;
+
+  tickit_term_goto(tt, 99, 9);
+
+  is_str(buffer, "\e[100;10H", "buffer after unbuffered write_csi");
+
+  buffer[0] = 0;
+
+  memcpy(tickit_termdrv_reserve(ttd, 16), "Reserved", 8);
+  tickit_termdrv_commit(ttd, 8);
+
+  is_str(buffer, "Reserved", "buffer after unbuffered reserve and commit");
+
+  buffer[0] = 0;
+
+  tickit_term_printf(tt, "%s-%s", "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ", "0123456789abcdefghijklmnopqrstuvwxyz");
+
+  is_str(buffer, "PRINT(abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ-0123456789abcdefghijklmnopqrstuvwxyz)",
+      "buffer after long printf");
+
   return exit_status();
 }
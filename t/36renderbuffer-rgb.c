@@ -0,0 +1,87 @@
+#include "tickit.h"
+#include "taplib.h"
+#include "taplib-mockterm.h"
+
+int main(int argc, char *argv[])
+{
+  TickitTerm *tt = make_term(25, 80);
+  TickitRenderBuffer *rb;
+  char buffer[256];
+
+  rb = tickit_renderbuffer_new(10, 20);
+
+  // Half-block pixels
+  {
+    unsigned char pixels[] = {
+      0xff,0x00,0x00,  0x00,0x00,0xff,
+      0xff,0x00,0x00,  0x00,0xff,0x00,
+      0xff,0xff,0xff,  0x00,0x00,0x00,
+    };
+
+    tickit_renderbuffer_rgb_at(rb, 2, 3, 2, 3, pixels, 0, NULL);
+
+    is_int(tickit_renderbuffer_get_cell_active(rb, 2, 3), 1, "get_cell_active solid cell");
+    is_int(tickit_renderbuffer_get_cell_text(rb, 2, 3, buffer, sizeof buffer), 0, "get_cell_text solid cell is erase");
+    is_int(tickit_pen_get_colour_attr(tickit_renderbuffer_get_cell_pen(rb, 2, 3), TICKIT_PEN_BG), 196, "solid cell bg");
+
+    is_int(tickit_renderbuffer_get_cell_text(rb, 2, 4, buffer, sizeof buffer), 3, "get_cell_text half-block cell");
+    is_str(buffer, "▀", "buffer text at 2,4");
+    is_int(tickit_pen_get_colour_attr(tickit_renderbuffer_get_cell_pen(rb, 2, 4), TICKIT_PEN_FG), 21, "half-block cell fg");
+    is_int(tickit_pen_get_colour_attr(tickit_renderbuffer_get_cell_pen(rb, 2, 4), TICKIT_PEN_BG), 46, "half-block cell bg");
+
+    is_int(tickit_pen_get_colour_attr(tickit_renderbuffer_get_cell_pen(rb, 3, 3), TICKIT_PEN_FG), 231, "odd final row fg");
+    ok(!tickit_pen_has_attr(tickit_renderbuffer_get_cell_pen(rb, 3, 3), TICKIT_PEN_BG), "odd final row has no bg");
+    is_int(tickit_pen_get_colour_attr(tickit_renderbuffer_get_cell_pen(rb, 3, 4), TICKIT_PEN_FG), 16, "odd final row black fg");
+
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer renders rgb_at to terminal",
+        GOTO(2,3), SETPEN(.bg=196), ERASECH(1,1),
+                   SETPEN(.fg=21,.bg=46), PRINT("▀"),
+        GOTO(3,3), SETPEN(.fg=231), PRINT("▀"),
+                   SETPEN(.fg=16), PRINT("▀"),
+        NULL);
+  }
+
+  // Runs of solid cells, nearest colour, and a given pen
+  {
+    unsigned char pixels[] = {
+      0x10,0x10,0x10,  0x12,0x12,0x12,  0x80,0x40,0x00,
+      0x10,0x10,0x10,  0x12,0x12,0x12,  0x80,0x40,0x00,
+    };
+    TickitPen *pen = tickit_pen_new_attrs(TICKIT_PEN_BOLD, 1, -1);
+
+    tickit_renderbuffer_rgb_at(rb, 0, 0, 3, 2, pixels, 0, pen);
+
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer renders rgb_at solid runs as erase",
+        GOTO(0,0), SETPEN(.bg=233), ERASECH(2,1),
+                   SETPEN(.bg=94), ERASECH(1,-1),
+        NULL);
+
+    ok(tickit_pen_get_bool_attr(tickit_mockterm_get_display_pen((TickitMockTerm *)tt, 0, 0), TICKIT_PEN_BOLD),
+        "given pen is merged into rgb_at cells");
+
+    tickit_pen_destroy(pen);
+  }
+
+  // Translation and clipping
+  {
+    unsigned char pixels[] = {
+      0x00,0x00,0xff,  0x00,0x00,0xff,  0x00,0x00,0xff,  0x00,0x00,0xff,
+    };
+
+    tickit_renderbuffer_translate(rb, 5, 17);
+    tickit_renderbuffer_rgb_at(rb, 0, 0, 4, 1, pixels, 0, NULL);
+
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer renders rgb_at with translation and clipping",
+        GOTO(5,17), SETPEN(.fg=21), PRINT("▀"),
+                    SETPEN(.fg=21), PRINT("▀"),
+                    SETPEN(.fg=21), PRINT("▀"),
+        NULL);
+  }
+
+  tickit_renderbuffer_destroy(rb);
+
+  return exit_status();
+}
@@ -0,0 +1,85 @@
+#include "tickit.h"
+#include "taplib.h"
+#include "taplib-mockterm.h"
+
+int main(int argc, char *argv[])
+{
+  TickitTerm *tt = make_term(25, 80);
+  TickitRenderBuffer *rb;
+  char buffer[256];
+
+  rb = tickit_renderbuffer_new(10, 20);
+
+  // Single dots
+  {
+    tickit_renderbuffer_braille_dot_at(rb, 8, 10, NULL);
+
+    is_int(tickit_renderbuffer_get_cell_active(rb, 2, 5), 1, "get_cell_active braille cell");
+    is_int(tickit_renderbuffer_get_cell_text(rb, 2, 5, buffer, sizeof buffer), 3, "get_cell_text braille cell");
+    is_str(buffer, "⠁", "buffer text at 2,5");
+
+    tickit_renderbuffer_braille_dot_at(rb, 11, 11, NULL);
+    tickit_renderbuffer_get_cell_text(rb, 2, 5, buffer, sizeof buffer);
+    is_str(buffer, "⢁", "dots accumulate within a cell");
+
+    tickit_renderbuffer_braille_dot_at(rb, 9, 12, NULL);
+
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer renders braille dots to terminal",
+        GOTO(2,5), SETPEN(), PRINT("⢁⠂"),
+        NULL);
+  }
+
+  // Pens
+  {
+    TickitPen *pen = tickit_pen_new_attrs(TICKIT_PEN_FG, 1, -1);
+
+    tickit_renderbuffer_braille_dot_at(rb, 0, 0, pen);
+    tickit_renderbuffer_braille_dot_at(rb, 0, 2, pen);
+    tickit_renderbuffer_braille_dot_at(rb, 0, 4, NULL);
+
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer renders braille runs split by pen",
+        GOTO(0,0), SETPEN(.fg=1), PRINT("⠁⠁"),
+                   SETPEN(), PRINT("⠁"),
+        NULL);
+
+    tickit_pen_destroy(pen);
+  }
+
+  // Lines
+  {
+    tickit_renderbuffer_braille_line_at(rb, 0, 0, 0, 5, NULL);
+
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer renders horizontal braille line",
+        GOTO(0,0), SETPEN(), PRINT("⠉⠉⠉"),
+        NULL);
+
+    tickit_renderbuffer_braille_line_at(rb, 7, 0, 0, 3, NULL);
+
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer renders diagonal braille line",
+        GOTO(0,1), SETPEN(), PRINT("⡜"),
+        GOTO(1,0), SETPEN(), PRINT("⡜"),
+        NULL);
+  }
+
+  // Translation and clipping
+  {
+    tickit_renderbuffer_translate(rb, 1, 1);
+    tickit_renderbuffer_braille_dot_at(rb, -1, -1, NULL);
+    tickit_renderbuffer_braille_dot_at(rb, -5, 0, NULL);
+
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer renders braille dots with translation and clipping",
+        GOTO(0,0), SETPEN(), PRINT("⢀"),
+        NULL);
+  }
+
+  tickit_renderbuffer_destroy(rb);
+
+  tickit_term_destroy(tt);
+
+  return exit_status();
+}
@@ -0,0 +1,241 @@
+#include "tickit.h"
+#include "taplib.h"
+#include "taplib-mockterm.h"
+
+#include "tickit-termdrv.h"
+
+int main(int argc, char *argv[])
+{
+  TickitTerm *tt = make_term(25, 80);
+  TickitRenderBuffer *rb;
+
+  TickitPen *pen_a = tickit_pen_new_attrs(TICKIT_PEN_FG, 1, TICKIT_PEN_BG, 4, TICKIT_PEN_BOLD, 1, -1);
+  TickitPen *pen_b = tickit_pen_new_attrs(TICKIT_PEN_FG, 2, TICKIT_PEN_BG, 7, TICKIT_PEN_UNDER, 1, -1);
+
+  rb = tickit_renderbuffer_new(10, 20);
+
+  is_int(tickit_renderbuffer_get_flush_flags(rb), 0, "flush flags initially 0");
+
+  // Alternating rows without grouping
+  {
+    for(int line = 0; line < 4; line++)
+      tickit_renderbuffer_text_at(rb, line, 0, "row", line % 2 ? pen_b : pen_a);
+
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer flushes alternating rows in linear order",
+        GOTO(0,0), SETPEN(.fg=1,.bg=4,.b=1), PRINT("row"),
+        GOTO(1,0), SETPEN(.fg=2,.bg=7,.u=1), PRINT("row"),
+        GOTO(2,0), SETPEN(.fg=1,.bg=4,.b=1), PRINT("row"),
+        GOTO(3,0), SETPEN(.fg=2,.bg=7,.u=1), PRINT("row"),
+        NULL);
+  }
+
+  tickit_renderbuffer_set_flush_flags(rb, TICKIT_RENDERBUFFER_FLUSH_GROUP_PENS);
+  is_int(tickit_renderbuffer_get_flush_flags(rb), TICKIT_RENDERBUFFER_FLUSH_GROUP_PENS, "flush flags set");
+
+  // Alternating rows with grouping
+  {
+    for(int line = 0; line < 4; line++)
+      tickit_renderbuffer_text_at(rb, line, 0, "row", line % 2 ? pen_b : pen_a);
+
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer flushes alternating rows grouped by pen",
+        GOTO(0,0), SETPEN(.fg=1,.bg=4,.b=1), PRINT("row"),
+        GOTO(2,0), SETPEN(.fg=1,.bg=4,.b=1), PRINT("row"),
+        GOTO(1,0), SETPEN(.fg=2,.bg=7,.u=1), PRINT("row"),
+        GOTO(3,0), SETPEN(.fg=2,.bg=7,.u=1), PRINT("row"),
+        NULL);
+
+    is_int(tickit_renderbuffer_get_flush_flags(rb), TICKIT_RENDERBUFFER_FLUSH_GROUP_PENS, "flush flags preserved by flush");
+  }
+
+  // Contiguous spans where grouping would cost more in cursor movement
+  {
+    TickitPen *pen_c = tickit_pen_new_attrs(TICKIT_PEN_FG, 3, -1);
+    TickitPen *pen_d = tickit_pen_new_attrs(TICKIT_PEN_FG, 4, -1);
+
+    tickit_renderbuffer_text_at(rb, 0, 0, "a", pen_c);
+    tickit_renderbuffer_text_at(rb, 0, 1, "b", pen_d);
+    tickit_renderbuffer_text_at(rb, 0, 2, "c", pen_c);
+
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer keeps linear order when cheaper",
+        GOTO(0,0), SETPEN(.fg=3), PRINT("a"),
+                   SETPEN(.fg=4), PRINT("b"),
+                   SETPEN(.fg=3), PRINT("c"),
+        NULL);
+
+    tickit_pen_destroy(pen_c);
+    tickit_pen_destroy(pen_d);
+  }
+
+  // Grouped erase and line regions
+  {
+    for(int line = 0; line < 4; line += 2) {
+      tickit_renderbuffer_erase_at(rb, line, 0, 5, pen_a);
+      tickit_renderbuffer_hline_at(rb, line + 1, 0, 4, TICKIT_LINE_SINGLE, pen_b, TICKIT_LINECAP_BOTH);
+    }
+
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer flushes grouped erase and line regions",
+        GOTO(0,0), SETPEN(.fg=1,.bg=4,.b=1), ERASECH(5,-1),
+        GOTO(2,0), SETPEN(.fg=1,.bg=4,.b=1), ERASECH(5,-1),
+        GOTO(1,0), SETPEN(.fg=2,.bg=7,.u=1), PRINT("─────"),
+        GOTO(3,0), SETPEN(.fg=2,.bg=7,.u=1), PRINT("─────"),
+        NULL);
+  }
+
+  // Repeated characters
+  {
+    tickit_renderbuffer_set_flush_flags(rb, TICKIT_RENDERBUFFER_FLUSH_REPEAT);
+
+    tickit_renderbuffer_text_at(rb, 0, 0, "ab-----c==", pen_a);
+    tickit_renderbuffer_hline_at(rb, 1, 0, 7, TICKIT_LINE_SINGLE, pen_a, TICKIT_LINECAP_BOTH);
+    tickit_renderbuffer_vline_at(rb, 1, 2, 2, TICKIT_LINE_SINGLE, pen_a, TICKIT_LINECAP_BOTH);
+
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer flushes repeated characters with printrep",
+        GOTO(0,0), SETPEN(.fg=1,.bg=4,.b=1), PRINT("ab"), PRINT("-----"), PRINT("c=="),
+        GOTO(1,0), SETPEN(.fg=1,.bg=4,.b=1), PRINT("──┼"), PRINT("─────"),
+        GOTO(2,2), SETPEN(.fg=1,.bg=4,.b=1), PRINT("│"),
+        NULL);
+  }
+
+  tickit_renderbuffer_destroy(rb);
+
+  // Line drawing with the alternate character set
+  {
+    rb = tickit_renderbuffer_new(10, 20);
+    tickit_renderbuffer_set_flush_flags(rb, TICKIT_RENDERBUFFER_FLUSH_ACS);
+
+    tickit_renderbuffer_hline_at(rb, 0, 0, 7, TICKIT_LINE_SINGLE, pen_a, TICKIT_LINECAP_BOTH);
+
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer ACS flush falls back to UTF-8 without terminal support",
+        GOTO(0,0), SETPEN(.fg=1,.bg=4,.b=1), PRINT("────────"),
+        NULL);
+  }
+
+  tickit_renderbuffer_destroy(rb);
+
+  // Erasing the bottom of the terminal
+  {
+    rb = tickit_renderbuffer_new(25, 80);
+
+    tickit_renderbuffer_text_at(rb, 20, 0, "Hello", pen_b);
+    tickit_renderbuffer_erase_at(rb, 20, 5, 75, pen_a);
+    for(int line = 21; line < 25; line++)
+      tickit_renderbuffer_erase_at(rb, line, 0, 80, pen_a);
+
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer erases the bottom of the terminal at once",
+        GOTO(20,0), SETPEN(.fg=2,.bg=7,.u=1), PRINT("Hello"),
+                    SETPEN(.fg=1,.bg=4,.b=1), ERASECH(75,-1),
+        GOTO(21,0), ERASECH(80,-1),
+        GOTO(22,0), ERASECH(80,-1),
+        GOTO(23,0), ERASECH(80,-1),
+        GOTO(24,0), ERASECH(80,-1),
+        NULL);
+
+    tickit_renderbuffer_destroy(rb);
+  }
+
+  // Repainting only what changed since the previous flush
+  {
+    rb = tickit_renderbuffer_new(10, 80);
+    tickit_renderbuffer_set_flush_flags(rb, TICKIT_RENDERBUFFER_FLUSH_DIFF);
+
+    tickit_renderbuffer_text_at(rb, 0, 0, "Hello world", pen_a);
+    tickit_renderbuffer_erase_at(rb, 0, 11, 69, pen_a);
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer diff flush outputs everything at first",
+        GOTO(0,0), SETPEN(.fg=1,.bg=4,.b=1), PRINT("Hello world"),
+                   SETPEN(.fg=1,.bg=4,.b=1), ERASECH(69,-1),
+        NULL);
+
+    tickit_renderbuffer_text_at(rb, 0, 0, "Hello world", pen_a);
+    tickit_renderbuffer_erase_at(rb, 0, 11, 69, pen_a);
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer diff flush outputs nothing for an unchanged frame",
+        NULL);
+
+    tickit_renderbuffer_text_at(rb, 0, 0, "Hello, world", pen_a);
+    tickit_renderbuffer_erase_at(rb, 0, 12, 68, pen_a);
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer diff flush shifts the line for inserted text",
+        SCROLLRECT(0,5,1,75, 0,-1),
+        GOTO(0,5), SETPEN(.fg=1,.bg=4,.b=1), PRINT(","),
+        NULL);
+
+    tickit_renderbuffer_text_at(rb, 0, 0, "Hello world", pen_a);
+    tickit_renderbuffer_erase_at(rb, 0, 11, 69, pen_a);
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer diff flush shifts the line for deleted text",
+        SCROLLRECT(0,5,1,75, 0,+1),
+        GOTO(0,79), SETPEN(.fg=1,.bg=4,.b=1), ERASECH(1,-1),
+        NULL);
+
+    tickit_renderbuffer_text_at(rb, 0, 0, "Jello", pen_a);
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer diff flush outputs only changed cells",
+        GOTO(0,0), SETPEN(.fg=1,.bg=4,.b=1), PRINT("J"),
+        NULL);
+
+    tickit_renderbuffer_invalidate(rb);
+
+    tickit_renderbuffer_text_at(rb, 0, 0, "Jello", pen_a);
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer diff flush outputs everything after invalidate",
+        GOTO(0,0), SETPEN(.fg=1,.bg=4,.b=1), PRINT("Jello"),
+        NULL);
+
+    tickit_term_clear(tt);
+    is_termlog("Terminal cleared",
+        CLEAR(),
+        NULL);
+
+    tickit_renderbuffer_text_at(rb, 0, 0, "Jello", pen_a);
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer diff flush outputs everything after the terminal is cleared",
+        GOTO(0,0), SETPEN(.fg=1,.bg=4,.b=1), PRINT("Jello"),
+        NULL);
+
+    tickit_termdrv_caps_changed(tickit_term_get_driver(tt));
+
+    tickit_renderbuffer_text_at(rb, 0, 0, "Jello", pen_a);
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer diff flush outputs everything after a change of capabilities",
+        GOTO(0,0), SETPEN(.fg=1,.bg=4,.b=1), PRINT("Jello"),
+        NULL);
+
+    tickit_renderbuffer_text_at(rb, 0, 0, "Jello", pen_a);
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer diff flush outputs nothing again after that",
+        NULL);
+
+    tickit_term_setctl_int(tt, TICKIT_TERMCTL_ALTSCREEN, 1);
+
+    tickit_renderbuffer_text_at(rb, 0, 0, "Jello", pen_a);
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer diff flush outputs everything after switching to the alternate screen",
+        GOTO(0,0), SETPEN(.fg=1,.bg=4,.b=1), PRINT("Jello"),
+        NULL);
+
+    tickit_term_setctl_int(tt, TICKIT_TERMCTL_ALTSCREEN, 0);
+
+    tickit_renderbuffer_text_at(rb, 0, 0, "Jello", pen_a);
+    tickit_renderbuffer_flush_to_term(rb, tt);
+    is_termlog("RenderBuffer diff flush outputs everything after switching back",
+        GOTO(0,0), SETPEN(.fg=1,.bg=4,.b=1), PRINT("Jello"),
+        NULL);
+
+    tickit_renderbuffer_destroy(rb);
+  }
+
+  tickit_pen_destroy(pen_a);
+  tickit_pen_destroy(pen_b);
+
+  tickit_term_destroy(tt);
+
+  return exit_status();
+}
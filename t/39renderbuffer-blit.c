@@ -0,0 +1,81 @@
+#include "tickit.h"
+#include "taplib.h"
+#include "taplib-mockterm.h"
+
+int main(int argc, char *argv[])
+{
+  TickitTerm *tt = make_term(25, 80);
+  TickitRenderBuffer *src, *dst;
+
+  TickitPen *fg = tickit_pen_new_attrs(TICKIT_PEN_FG, 1, -1);
+  TickitPen *bg = tickit_pen_new_attrs(TICKIT_PEN_BG, 2, -1);
+
+  src = tickit_renderbuffer_new(10, 20);
+  dst = tickit_renderbuffer_new(10, 20);
+
+  // Each kind of cell
+  {
+    tickit_renderbuffer_text_at(src, 0, 2, "Hello", fg);
+    tickit_renderbuffer_erase_at(src, 1, 0, 3, bg);
+    tickit_renderbuffer_char_at(src, 2, 5, 'X', NULL);
+    tickit_renderbuffer_hline_at(src, 3, 0, 2, TICKIT_LINE_SINGLE, NULL, 0);
+
+    tickit_renderbuffer_blit(dst, src);
+    tickit_renderbuffer_flush_to_term(dst, tt);
+    is_termlog("RenderBuffer blits text, erase, char and line cells",
+        GOTO(0,2), SETPEN(.fg=1), PRINT("Hello"),
+        GOTO(1,0), SETPEN(.bg=2), ERASECH(3,-1),
+        GOTO(2,5), SETPEN(), PRINT("X"),
+        GOTO(3,0), SETPEN(), PRINT("╶─╴"),
+        NULL);
+
+    tickit_renderbuffer_flush_to_term(src, tt);
+    is_termlog("RenderBuffer blit leaves the source intact",
+        GOTO(0,2), SETPEN(.fg=1), PRINT("Hello"),
+        GOTO(1,0), SETPEN(.bg=2), ERASECH(3,-1),
+        GOTO(2,5), SETPEN(), PRINT("X"),
+        GOTO(3,0), SETPEN(), PRINT("╶─╴"),
+        NULL);
+  }
+
+  // Skipped cells leave the destination alone
+  {
+    tickit_renderbuffer_text_at(dst, 0, 0, "abcdefgh", NULL);
+    tickit_renderbuffer_text_at(src, 0, 0, "12345678", NULL);
+    tickit_renderbuffer_skip_at(src, 0, 2, 3);
+
+    tickit_renderbuffer_blit(dst, src);
+    tickit_renderbuffer_flush_to_term(dst, tt);
+    is_termlog("RenderBuffer blit keeps destination under skipped cells",
+        GOTO(0,0), SETPEN(), PRINT("12"), SETPEN(), PRINT("cde"), SETPEN(), PRINT("678"),
+        NULL);
+
+    tickit_renderbuffer_reset(src);
+  }
+
+  // Destination translation and clipping apply
+  {
+    tickit_renderbuffer_text_at(src, 0, 0, "Hello", NULL);
+
+    tickit_renderbuffer_translate(dst, 2, 3);
+    tickit_renderbuffer_clip(dst, &(TickitRect){.top = 0, .left = 0, .lines = 5, .cols = 4});
+
+    tickit_renderbuffer_blit(dst, src);
+    tickit_renderbuffer_flush_to_term(dst, tt);
+    is_termlog("RenderBuffer blit respects destination translation and clip",
+        GOTO(2,3), SETPEN(), PRINT("Hell"),
+        NULL);
+
+    tickit_renderbuffer_reset(src);
+  }
+
+  tickit_renderbuffer_destroy(src);
+  tickit_renderbuffer_destroy(dst);
+
+  tickit_pen_destroy(fg);
+  tickit_pen_destroy(bg);
+
+  tickit_term_destroy(tt);
+
+  return exit_status();
+}
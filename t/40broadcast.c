@@ -0,0 +1,106 @@
+#include "tickit.h"
+#include "taplib.h"
+
+#include <string.h>
+
+#define N_VIEWERS 4
+
+static char buffers[N_VIEWERS][1024];
+
+static void output(TickitTerm *tt, const char *bytes, size_t len, void *user)
+{
+  char *buffer = user;
+  strncat(buffer, bytes, len);
+}
+
+static TickitTerm *make_viewer(const char *termtype, char *buffer)
+{
+  TickitTerm *tt = tickit_term_new_for_termtype(termtype);
+
+  tickit_term_set_utf8(tt, true);
+  tickit_term_set_size(tt, 5, 20);
+  tickit_term_set_output_func(tt, output, buffer);
+  tickit_term_set_output_buffer(tt, 4096);
+
+  tickit_term_flush(tt);
+  buffer[0] = 0;
+
+  return tt;
+}
+
+static void clear_buffers(void)
+{
+  for(int i = 0; i < N_VIEWERS; i++)
+    buffers[i][0] = 0;
+}
+
+int main(int argc, char *argv[])
+{
+  TickitTerm *viewers[N_VIEWERS];
+  TickitBroadcast *bc;
+  TickitRenderBuffer *rb;
+
+  /* Two profiles; the first two viewers share one */
+  viewers[0] = make_viewer("xterm", buffers[0]);
+  viewers[1] = make_viewer("xterm", buffers[1]);
+  viewers[2] = make_viewer("xterm-256color", buffers[2]);
+  viewers[3] = make_viewer("xterm", buffers[3]);
+
+  bc = tickit_broadcast_new(5, 20);
+  rb = tickit_renderbuffer_new(5, 20);
+
+  ok(!!bc, "tickit_broadcast_new");
+
+  for(int i = 0; i < 3; i++)
+    ok(tickit_broadcast_add_term(bc, viewers[i]), "tickit_broadcast_add_term");
+  ok(!tickit_broadcast_add_term(bc, viewers[0]), "tickit_broadcast_add_term fails for a term already added");
+
+  is_str_escape(buffers[0], "\e[m\e[2J", "viewer is cleared on joining");
+
+  clear_buffers();
+
+  tickit_renderbuffer_text_at(rb, 1, 2, "Hello", NULL);
+  tickit_broadcast_flush(bc, rb);
+
+  is_str_escape(buffers[0], "\e[2;3H\e[mHello", "frame written to first viewer");
+  is_str_escape(buffers[1], "\e[2;3H\e[mHello", "frame written to second viewer of the same profile");
+  is_str_escape(buffers[2], "\e[2;3H\e[mHello", "frame written to viewer of another profile");
+
+  ok(!tickit_renderbuffer_get_cell_active(rb, 1, 2), "tickit_broadcast_flush resets the renderbuffer");
+
+  /* A late joiner is repainted with everything drawn so far, and left in the
+   * same state as the others */
+  clear_buffers();
+
+  ok(tickit_broadcast_add_term(bc, viewers[3]), "tickit_broadcast_add_term late joiner");
+  is_str_escape(buffers[3], "\e[m\e[2J\e[2;3HHello", "late joiner repainted");
+
+  clear_buffers();
+
+  tickit_renderbuffer_text_at(rb, 1, 7, "!", NULL);
+  tickit_broadcast_flush(bc, rb);
+
+  is_str_escape(buffers[0], "!", "next frame written to first viewer");
+  is_str_escape(buffers[3], "!", "next frame written to late joiner");
+
+  /* Removed viewers see no more frames */
+  tickit_broadcast_remove_term(bc, viewers[0]);
+  tickit_broadcast_remove_term(bc, viewers[2]);
+
+  clear_buffers();
+
+  tickit_renderbuffer_text_at(rb, 2, 0, "Bye", NULL);
+  tickit_broadcast_flush(bc, rb);
+
+  is_str_escape(buffers[0], "", "nothing written to a removed viewer");
+  is_str_escape(buffers[1], "\e[3HBye", "frame still written to remaining viewer");
+  is_str_escape(buffers[2], "", "nothing written to viewer of a removed profile");
+
+  tickit_renderbuffer_destroy(rb);
+  tickit_broadcast_destroy(bc);
+
+  for(int i = 0; i < N_VIEWERS; i++)
+    tickit_term_destroy(viewers[i]);
+
+  return exit_status();
+}